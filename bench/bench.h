@@ -0,0 +1,132 @@
+/**
+ * @brief Minimal benchmark harness shared by swic benchmarks.
+ * @file bench.h
+ *
+ * Results are collected into a JSON document of the form
+ * `{"benchmarks": [...], "pass": bool}` and compared against regression
+ * thresholds loaded from a JSON file mapping benchmark names to maximal
+ * allowed mean time per unit (device/frame) in microseconds. Threshold for
+ * specific unit count can be given as `"<name>/<units>"`, which takes
+ * precedence over plain `"<name>"`.
+ */
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace bench {
+  using json = nlohmann::json;
+  using clock = std::chrono::steady_clock;
+
+  /// Collects benchmark results and checks them against thresholds.
+  class Suite {
+  public:
+    /// Minimal total time spent measuring one benchmark.
+    std::chrono::milliseconds m_MinTime{200};
+    /// Maximal number of iterations of one benchmark.
+    int m_MaxIterations = 1000;
+
+    /**
+     * @brief Create suite with thresholds loaded from file.
+     * @param thresholds_path Path to thresholds JSON, empty for no thresholds.
+     */
+    Suite(const std::string& thresholds_path = "") {
+      if (thresholds_path.empty())
+        return;
+      std::ifstream stream(thresholds_path);
+      if (!stream.is_open())
+        throw std::runtime_error("Failed to open thresholds " + thresholds_path);
+      stream >> m_thresholds;
+    }
+
+    /**
+     * @brief Run `func` repeatedly and record its timing.
+     * @param name Benchmark name, also key in the thresholds file.
+     * @param units Number of units (devices, frames...) processed per call.
+     * @param func Function to measure.
+     * @param extra Additional values stored with the result.
+     */
+    void Run(const std::string& name, int units, const std::function<void()>& func,
+             json extra = json::object()) {
+      std::vector<double> samples;
+      auto start = clock::now();
+      do {
+        auto t0 = clock::now();
+        func();
+        samples.push_back(std::chrono::duration<double, std::micro>(clock::now() - t0).count());
+      } while (clock::now() - start < m_MinTime && (int)samples.size() < m_MaxIterations);
+      Record(name, units, samples, std::move(extra));
+    }
+
+    /// Record already measured samples (microseconds per call).
+    void Record(const std::string& name, int units, std::vector<double> samples,
+                json extra = json::object()) {
+      std::sort(samples.begin(), samples.end());
+      double sum = 0.0;
+      for (double s : samples)
+        sum += s;
+      double mean = sum / samples.size();
+      auto pct = [&](double p) { return samples[std::min(samples.size() - 1, size_t(p * samples.size()))]; };
+
+      json res = extra;
+      res["name"] = name;
+      res["units"] = units;
+      res["iterations"] = samples.size();
+      res["mean_us"] = mean;
+      res["min_us"] = samples.front();
+      res["p50_us"] = pct(0.50);
+      res["p99_us"] = pct(0.99);
+      res["per_unit_us"] = mean / std::max(units, 1);
+
+      std::string key = name + "/" + std::to_string(units);
+      if (!m_thresholds.contains(key))
+        key = name;
+      if (m_thresholds.contains(key)) {
+        double threshold = m_thresholds[key].get<double>();
+        bool pass = mean / std::max(units, 1) <= threshold;
+        res["threshold_us"] = threshold;
+        res["pass"] = pass;
+        if (!pass) {
+          m_pass = false;
+          std::cerr << "REGRESSION: " << name << " (" << units << ") "
+                    << mean / std::max(units, 1) << " us > " << threshold << " us" << std::endl;
+        }
+      }
+      m_results.push_back(res);
+    }
+
+    /// Record result of a check, which fails the suite unless it passed.
+    void Check(const std::string& name, bool pass, json extra = json::object()) {
+      json res = extra;
+      res["name"] = name;
+      res["pass"] = pass;
+      if (!pass) {
+        m_pass = false;
+        std::cerr << "FAILED: " << name << " " << extra.dump() << std::endl;
+      }
+      m_results.push_back(res);
+    }
+
+    /// Print results as JSON to stdout and return process exit code.
+    int Finish() {
+      json out = {{"benchmarks", m_results}, {"pass", m_pass}};
+      std::cout << out.dump(2) << std::endl;
+      return m_pass ? 0 : 1;
+    }
+
+  private:
+    json m_thresholds = json::object();
+    json m_results = json::array();
+    bool m_pass = true;
+  };
+
+  /// Prevent the compiler from optimizing away a value.
+  template <typename T> inline void keep(T const& val) {
+    asm volatile("" : : "r,m"(val) : "memory");
+  }
+}
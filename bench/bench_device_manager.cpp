@@ -0,0 +1,459 @@
+/**
+ * @brief Benchmarks of DeviceMan discovery, apply and config generation.
+ * @file bench_device_manager.cpp
+ *
+ * Usage: bench_device_manager <swic-swaymock path> [thresholds.json] [sessions...]
+ *
+ * Synthetic device sets are served by swic-swaymock, which is used as
+ * `swaymsg_path`, so the measured times include spawning the processes
+ * exactly like with real swaymsg. Applying changes spawns one process per
+ * device, so the apply benchmarks are limited to at most
+ * `SWIC_BENCH_APPLY_MAX` devices (100 by default).
+ *
+ * Applying over the sway socket is measured against in-process mock served
+ * on a unix socket, once device by device and once pipelined.
+ *
+ * An instance attached to the daemon must be served while another one
+ * stalls in the middle of a request.
+ *
+ * Requests to a mock delaying its replies must fail once their timeout
+ * passes, both over the socket and through swic-swaymock as swaymsg.
+ *
+ * Recorded sessions (`swic --record <file>`) given as additional arguments
+ * are replayed with discovery and apply of every device. A synthetic session
+ * recorded against in-process mock is always replayed.
+ */
+#include "bench.h"
+#include "../src/capability_cache.h"
+#include "../src/daemon.h"
+#include "../src/device_manager.h"
+#include "../src/device_index.h"
+#include "../src/ipc_record.h"
+#include "../src/perf.h"
+#include "../src/preset_library.h"
+#include "../src/mock/sway_mock.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+// Allocation checks would pass trivially without the counting operator new.
+static_assert(perf::ALLOC_STATS, "Benchmarks must be built with SWIC_ALLOC_STATS");
+
+// Indices of all devices.
+static std::vector<int> all_devices(const DeviceMan& man) {
+  std::vector<int> devices(man.m_Devices.size());
+  for (int i = 0; i < (int)devices.size(); i++)
+    devices[i] = i;
+  return devices;
+}
+
+// Discover devices and apply changes to all of them over given transport.
+static void run_session(std::unique_ptr<ipc::Transport> transport) {
+  DeviceMan man(std::move(transport));
+  man.ApplyChanges(all_devices(man));
+}
+
+// Mock transport counting discoveries which reached sway.
+class CountingTransport : public mock::MockTransport {
+public:
+  CountingTransport(mock::SwayMock& sway, std::atomic<int>& discoveries)
+    : MockTransport(sway), m_discoveries(discoveries) {}
+  std::string Request(ipc::MsgType type, const std::string& payload) override {
+    if (type == ipc::MsgType::get_inputs)
+      m_discoveries++;
+    return MockTransport::Request(type, payload);
+  }
+
+private:
+  std::atomic<int>& m_discoveries;
+};
+
+// Serve sway IPC by SwayMock on unix socket, one request at a time like sway.
+class MockServer {
+public:
+  MockServer(mock::SwayMock& sway, const std::string& path) : m_path(path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_fd < 0 || bind(m_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(m_fd, 4) < 0)
+      throw std::runtime_error("Failed to listen on " + path);
+    m_thread = std::thread([this, &sway]() {
+      int client;
+      while ((client = accept(m_fd, nullptr, nullptr)) >= 0) {
+        while (auto msg = ipc::read_message(client))
+          if (!ipc::write_message(client, msg->type, sway.Handle(ipc::MsgType(msg->type), msg->payload)))
+            break;
+        close(client);
+      }
+    });
+  }
+  ~MockServer() {
+    shutdown(m_fd, SHUT_RDWR);
+    m_thread.join();
+    close(m_fd);
+    unlink(m_path.c_str());
+  }
+
+private:
+  std::string m_path;
+  int m_fd;
+  std::thread m_thread;
+};
+
+// Check that request to stalled sway fails with TimeoutError soon after the
+// timeout instead of waiting for the reply.
+static void check_timeout(bench::Suite& suite, const char* name, ipc::Transport& transport,
+                          std::chrono::milliseconds timeout) {
+  transport.SetTimeout(timeout);
+  bool timed_out = false;
+  auto start = std::chrono::steady_clock::now();
+  try {
+    transport.Request(ipc::MsgType::get_inputs, "");
+  } catch (const ipc::TimeoutError&) {
+    timed_out = true;
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+  suite.Check(name, timed_out && elapsed < 4 * timeout, {{"timeout_ms", timeout.count()},
+                                                         {"elapsed_ms", elapsed.count()}});
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <swic-swaymock path> [thresholds.json] [sessions...]" << std::endl;
+    return 1;
+  }
+  std::string swaymock = argv[1];
+  const char* apply_max_env = std::getenv("SWIC_BENCH_APPLY_MAX");
+  int apply_max = apply_max_env ? std::atoi(apply_max_env) : 100;
+
+  try {
+    bench::Suite suite(argc > 2 ? argv[2] : "");
+
+    // Runtime directory of the daemon started by the attach benchmark.
+    std::filesystem::path runtime_dir = std::filesystem::temp_directory_path() / "swic-bench-runtime";
+    std::filesystem::create_directories(runtime_dir);
+    setenv("XDG_RUNTIME_DIR", runtime_dir.c_str(), 1);
+    unsetenv("SWAYSOCK");
+
+    for (int count : {1, 10, 100, 1000}) {
+      bench::json extra = {{"devices", count}};
+      setenv("SWIC_MOCK_DEVICES", std::to_string(count).c_str(), 1);
+
+      // Discovery end to end including spawning of swaymsg.
+      suite.Run("parse_swaymsg", count, [&]() {
+        DeviceMan man(swaymock);
+        bench::keep(man.m_Devices.size());
+      }, extra);
+
+      // Conversion of json to Device only.
+      bench::json inputs = mock::SwayMock::GenerateInputs(count);
+      suite.Run("from_json", count, [&]() {
+        for (auto& j : inputs) {
+          auto device = j.get<Opt<Device>>();
+          bench::keep(device);
+        }
+      }, extra);
+
+      // Repeated discovery in process, json DOM reuses the arena of the
+      // previous pass.
+      {
+        mock::SwayMock sway(count);
+        DeviceMan refreshed(std::make_unique<mock::MockTransport>(sway));
+        int devices = refreshed.m_Devices.size();
+        refreshed.Refresh();
+        uint64_t allocs = perf::thread_allocs();
+        refreshed.Refresh();
+        allocs = perf::thread_allocs() - allocs;
+        bench::json refresh_extra = extra;
+        refresh_extra["allocs_per_device"] = (double)allocs / devices;
+        suite.Run("refresh_devices", devices, [&]() {
+          refreshed.Refresh();
+          bench::keep(refreshed.m_Devices.size());
+        }, refresh_extra);
+      }
+
+      // Discovery of an instance attached to a running daemon, devices are
+      // read from its snapshot without any request to sway.
+      {
+        mock::SwayMock sway(count);
+        std::atomic<int> discoveries{0};
+        Daemon daemon(std::make_unique<CountingTransport>(sway, discoveries));
+        std::thread thread([&]() { daemon.Run(); });
+        suite.Run("attach_devices", count, [&]() {
+          DeviceMan attached(DaemonTransport::Attach());
+          bench::keep(attached.m_Devices.size());
+        }, extra);
+        if (count == 1) {
+          // Instance which sent half a request and stopped never stalls the
+          // daemon for the others.
+          int stalled = ipc::connect_socket(Daemon::SocketPath());
+          std::string request = ipc::encode(ipc::MsgType::get_version, "");
+          [[maybe_unused]] ssize_t n = write(stalled, request.data(), ipc::HEADER_SIZE / 2);
+          auto attached = DaemonTransport::Attach();
+          attached->SetTimeout(std::chrono::milliseconds(1000));
+          bool replied = false;
+          try {
+            attached->Request(ipc::MsgType::get_version, "");
+            replied = true;
+          } catch (const ipc::TimeoutError&) {}
+          close(stalled);
+          suite.Check("daemon_stalled_client", replied);
+        }
+        daemon.Stop();
+        thread.join();
+        // Only the daemon itself discovered the devices.
+        suite.Check("attach_no_discovery", discoveries == 1, {{"devices", count},
+                                                                {"discoveries", discoveries.load()}});
+      }
+
+      DeviceMan man(swaymock);
+      int managed = man.m_Devices.size();
+      extra["managed"] = managed;
+
+      suite.Run("get_sway_config", managed, [&]() {
+        for (int i = 0; i < managed; i++) {
+          std::string conf = man.GetSwayConfig(i, i % 2);
+          bench::keep(conf);
+        }
+      }, extra);
+
+      // Command batches and config of every device into one reused buffer.
+      std::string buffer;
+      auto format_all = [&]() {
+        for (int i = 0; i < managed; i++) {
+          buffer.clear();
+          man.AppendCommands(i, buffer);
+          man.AppendSwayConfig(i, buffer, i % 2);
+        }
+      };
+      format_all();
+      uint64_t allocs = perf::thread_allocs();
+      format_all();
+      allocs = perf::thread_allocs() - allocs;
+      bench::json format_extra = extra;
+      format_extra["allocs_per_device"] = (double)allocs / managed;
+      suite.Run("format_commands", managed, [&]() {
+        format_all();
+        bench::keep(buffer);
+      }, format_extra);
+
+      suite.Run("backup_copy", managed, [&]() {
+        std::vector<Device> copy = man.m_Devices;
+        bench::keep(copy);
+      }, extra);
+
+      // Query typed character by character into the device search.
+      DeviceIndex index;
+      index.Update(man);
+      const std::string query = "mock type:touchpad";
+      suite.Run("filter_devices", managed, [&]() {
+        for (size_t len = 0; len <= query.size(); len++)
+          bench::keep(index.Filter(std::string_view(query).substr(0, len)).size());
+      }, extra);
+
+      // Sway config with a block for every device and type.
+      std::string config_path = (std::filesystem::temp_directory_path() / "swic-bench-sway.conf").string();
+      {
+        std::ofstream config(config_path);
+        config << "set $mod Mod4\nbindsym $mod+Return exec foot\ninput * xkb_numlock enabled\n";
+        for (auto& dev : man.m_Devices)
+          config << "input \"" << dev.sway_id << "\" {\n    map_to_region 0 0 1920 1080\n"
+                 << "    xkb_layout us,de\n    accel_speed 0.5\n}\n";
+      }
+      std::stringstream config_text;
+      config_text << std::ifstream(config_path).rdbuf();
+      suite.Run("tokenize_sway_config", managed, [&]() {
+        bench::keep(swaycfg::tokenize(config_text.str()).size());
+      }, extra);
+      // Tokens of unchanged file are cached.
+      suite.Run("import_sway_config", managed, [&]() {
+        bench::keep(man.ImportSwayConfig(config_path));
+      }, extra);
+      std::filesystem::remove(config_path);
+
+      // Library with a preset for every device among presets of many others,
+      // only the presets of managed devices are read.
+      std::string library_path = (std::filesystem::temp_directory_path() / "swic-bench-presets.lib").string();
+      {
+        std::vector<PresetLibrary::Entry> entries;
+        for (int i = 0; i < 10000; i++)
+          entries.push_back({"1:" + std::to_string(i) + ":Other", DevType::pointer,
+                             "    accel_speed 0.25\n    natural_scroll enabled\n"});
+        for (auto& dev : man.m_Devices)
+          entries.push_back({dev.sway_id, dev.type,
+                             "    accel_speed 0.5\n    repeat_rate 40\n    xkb_layout \"us,de\"\n"});
+        PresetLibrary::Write(library_path, entries);
+      }
+      suite.Run("load_presets", managed, [&]() {
+        bench::keep(man.LoadPresets(library_path));
+      }, extra);
+      std::filesystem::remove(library_path);
+
+      std::vector<Device> backup = man.m_Devices;
+      suite.Run("restore_copy", managed, [&]() {
+        man.m_Devices = backup;
+        bench::keep(man.m_Devices);
+      }, extra);
+
+      if (managed > apply_max)
+        continue;
+
+      int next = 0;
+      suite.Run("apply_device", 1, [&]() {
+        man.ApplyChanges(next++ % managed);
+      }, extra);
+
+      std::vector<int> devices = all_devices(man);
+      suite.Run("apply_bulk", managed, [&]() {
+        man.ApplyChanges(devices);
+      }, extra);
+    }
+
+    // Device by device and pipelined applies over the socket.
+    {
+      mock::SwayMock sway(100);
+      std::string socket_path = (std::filesystem::temp_directory_path() / "swic-bench.sock").string();
+      MockServer server(sway, socket_path);
+      bench::json extra = {{"devices", 100}};
+      // Server handles one connection at a time, so discovery goes first.
+      suite.Run("discovery_socket", 1, [&]() {
+        DeviceMan discovered(std::make_unique<ipc::SocketTransport>(socket_path));
+        bench::keep(discovered.m_Devices.size());
+      }, extra);
+
+      DeviceMan man(std::make_unique<ipc::SocketTransport>(socket_path));
+      int managed = man.m_Devices.size();
+      std::vector<int> devices = all_devices(man);
+      extra["managed"] = managed;
+
+      suite.Run("apply_socket_sequential", managed, [&]() {
+        for (int i : devices)
+          man.ApplyChanges(i);
+      }, extra);
+      suite.Run("apply_socket_pipelined", managed, [&]() {
+        man.ApplyChanges(devices);
+      }, extra);
+    }
+
+    // Sway stops a batch at a rejected setting, the rest of it must be sent
+    // again, each command exactly once.
+    {
+      mock::SwayMock sway(12);
+      sway.m_Rejected = {"scroll_factor"};
+      DeviceMan man(std::make_unique<mock::MockTransport>(sway));
+      std::string batch;
+      size_t expected = 0;
+      for (int i = 0; i < (int)man.m_Devices.size(); i++) {
+        batch.clear();
+        man.AppendCommands(i, batch);
+        expected += std::count(batch.begin(), batch.end(), ';');
+      }
+      man.ApplyChanges(all_devices(man));
+      suite.Check("apply_rejected_rest", sway.m_Commands.size() == expected,
+                  {{"expected", expected}, {"sent", sway.m_Commands.size()}});
+    }
+
+    // Refused value fails only that apply, the setting is sent again by the
+    // next one and isn't cached as unsupported.
+    {
+      mock::SwayMock sway(12);
+      sway.m_Invalid = {"scroll_factor"};
+      DeviceMan man(std::make_unique<mock::MockTransport>(sway));
+      std::string batch;
+      size_t expected = 0;
+      for (int i = 0; i < (int)man.m_Devices.size(); i++) {
+        batch.clear();
+        man.AppendCommands(i, batch);
+        expected += std::count(batch.begin(), batch.end(), ';');
+      }
+      man.ApplyChanges(all_devices(man));
+      man.ApplyChanges(all_devices(man));
+      bool cached = false;
+      for (auto& dev : man.m_Devices)
+        cached |= man.Capabilities().Rejected(dev.sway_id) != 0;
+      suite.Check("apply_value_error_not_cached",
+                  !cached && sway.m_Commands.size() == 2 * expected && !man.ApplyErrors().empty(),
+                  {{"expected", 2 * expected}, {"sent", sway.m_Commands.size()},
+                   {"errors", man.ApplyErrors().size()}});
+    }
+
+    // Name with quotes, backslash and `;` is a single argument of every
+    // command of its batch.
+    {
+      mock::SwayMock sway(1);
+      std::string id = R"(1:1:Mock_"quoted";_\name)";
+      sway.m_Inputs[0]["identifier"] = id;
+      DeviceMan man(std::make_unique<mock::MockTransport>(sway));
+      man.ApplyChanges(0);
+      bool quoted = !sway.m_Commands.empty();
+      for (auto& cmd : sway.m_Commands)
+        quoted &= cmd.starts_with("input " + id + " ");
+      suite.Check("apply_quoted_name", quoted, {{"sent", sway.m_Commands.size()}});
+    }
+
+    // Stalled sway. The socket connects again after the timeout, so the late
+    // reply isn't taken for the reply to the next request.
+    {
+      constexpr std::chrono::milliseconds TIMEOUT{50};
+      mock::SwayMock sway(1);
+      sway.m_Latency = std::chrono::milliseconds(500);
+      std::string socket_path = (std::filesystem::temp_directory_path() / "swic-bench-stall.sock").string();
+      MockServer server(sway, socket_path);
+      ipc::SocketTransport socket(socket_path);
+      check_timeout(suite, "timeout_socket", socket, TIMEOUT);
+      sway.m_Latency = {};
+      socket.SetTimeout(ipc::DEFAULT_TIMEOUT);
+      bool recovered = false;
+      try {
+        recovered = !bench::json::parse(socket.Request(ipc::MsgType::get_outputs, "")).empty();
+      } catch (const std::runtime_error&) {}
+      suite.Check("timeout_socket_recovers", recovered);
+
+      setenv("SWIC_MOCK_LATENCY_MS", "500", 1);
+      ipc::SwaymsgTransport swaymsg(swaymock);
+      check_timeout(suite, "timeout_swaymsg", swaymsg, TIMEOUT);
+      // Requests queued behind the timed out one are cancelled with it.
+      auto first = swaymsg.Submit(ipc::MsgType::get_inputs, "");
+      auto second = swaymsg.Submit(ipc::MsgType::get_outputs, "");
+      int cancelled = 0;
+      for (auto ticket : {first, second}) {
+        try {
+          swaymsg.Wait(ticket);
+        } catch (const ipc::TimeoutError&) {
+          cancelled++;
+        } catch (const std::runtime_error&) {}
+      }
+      suite.Check("timeout_swaymsg_queued", cancelled == 2, {{"cancelled", cancelled}});
+      unsetenv("SWIC_MOCK_LATENCY_MS");
+    }
+
+    // Record synthetic session and replay it along with given sessions.
+    std::vector<std::string> sessions(argv + std::min(argc, 3), argv + argc);
+    std::string synthetic = (std::filesystem::temp_directory_path() / "swic-bench.swicrec").string();
+    {
+      mock::SwayMock sway(100);
+      run_session(std::make_unique<ipc::Recorder>(std::make_unique<mock::MockTransport>(sway), synthetic));
+    }
+    sessions.insert(sessions.begin(), synthetic);
+
+    for (auto& session : sessions) {
+      int requests = ipc::load_records(session).size();
+      suite.Run("replay_session", requests, [&]() {
+        run_session(std::make_unique<ipc::ReplayTransport>(session));
+      }, {{"session", std::filesystem::path(session).filename().string()}});
+    }
+    std::filesystem::remove(synthetic);
+
+    return suite.Finish();
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,152 @@
+/**
+ * @brief Headless frame benchmark of gui::DeviceEditor and gui::MenuBar.
+ * @file bench_gui.cpp
+ *
+ * Usage: bench_gui <swic-swaymock path> [thresholds.json]
+ *
+ * Creates ImGui context without any window or renderer and drives the GUI
+ * for thousands of frames against mock devices of every DevType, with
+ * every options tab and the "Sway config" node open. Reports per-frame CPU
+ * time and number of heap allocations per frame.
+ *
+ * Afterwards every device/tab combination is left idle with the performance
+ * overlay open. Idle frames must not allocate at all, the benchmark fails
+ * if any of them does.
+ */
+#include "bench.h"
+#include "../src/device_manager.h"
+#include "../src/gui/gui.h"
+#include "../src/perf.h"
+#include <cstdlib>
+
+// Allocation checks would pass trivially without the counting operator new.
+static_assert(perf::ALLOC_STATS, "Benchmarks must be built with SWIC_ALLOC_STATS");
+
+/// Frames rendered for every device/tab combination.
+constexpr int FRAMES = 500;
+/// Frames after which an idle device/tab must stop allocating.
+constexpr int IDLE_WARMUP = 5;
+/// Idle frames checked for allocations for every device/tab combination.
+constexpr int IDLE_FRAMES = 100;
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <swic-swaymock path> [thresholds.json]" << std::endl;
+    return 1;
+  }
+
+  try {
+    bench::Suite suite(argc > 2 ? argv[2] : "");
+
+    // One device of every generated type.
+    setenv("SWIC_MOCK_DEVICES", "6", 1);
+    DeviceMan man(argv[1]);
+    Configuration config;
+
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.LogFilename = nullptr;
+    io.DisplaySize = ImVec2(500, 700);
+    io.DeltaTime = 1.0f / 60.0f;
+    unsigned char* pixels;
+    int width, height;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+    EventLoop event_loop;
+    gui::DeviceEditor editor(man, config, event_loop);
+    gui::PerfOverlay perf_overlay;
+    gui::MenuBar menu_bar(perf_overlay);
+
+    using Tab = gui::DeviceEditor::Tab;
+    const std::pair<Tab, const char*> tabs[] = {
+      {Tab::keyboard, "keyboard"}, {Tab::tablet, "tablet"},
+      {Tab::mapping, "mapping"}, {Tab::libinput, "libinput"}};
+
+    // Same conditions as in DeviceEditor::guiOptions().
+    auto has_tab = [](Device& d, Tab tab) {
+      switch (tab) {
+      case Tab::keyboard: return d.type == DevType::keyboard;
+      case Tab::tablet: return d.type == DevType::tablet_tool;
+      case Tab::mapping: return d.map_to_output || d.map_to_region;
+      default: return true;
+      }
+    };
+
+    for (int dev = 0; dev < (int)man.m_Devices.size(); dev++) {
+      for (auto& [tab, tab_name] : tabs) {
+        if (!has_tab(man.m_Devices[dev], tab))
+          continue;
+        editor.Select(dev, tab);
+        editor.ShowSwayConfig(true);
+
+        std::vector<double> samples;
+        samples.reserve(FRAMES);
+        uint64_t allocs_total = 0, allocs_max = 0;
+        for (int frame = 0; frame < FRAMES; frame++) {
+          uint64_t allocs = perf::thread_allocs();
+          uint64_t start = perf::now_us(perf::Clock::thread);
+
+          ImGui::NewFrame();
+          menu_bar.OnUpdate(io.DeltaTime);
+          editor.OnUpdate(io.DeltaTime);
+          ImGui::Render();
+
+          samples.push_back(perf::now_us(perf::Clock::thread) - start);
+          // Skip first frames, which set up windows and tab bars.
+          if (frame >= 2) {
+            allocs = perf::thread_allocs() - allocs;
+            allocs_total += allocs;
+            allocs_max = std::max(allocs_max, allocs);
+          }
+        }
+
+        Device& d = man.m_Devices[dev];
+        suite.Record("frame", 1, std::move(samples), {
+          {"device_type", GetTypeName(d.type)},
+          {"tab", tab_name},
+          {"allocs_per_frame", double(allocs_total) / (FRAMES - 2)},
+          {"allocs_max", allocs_max},
+        });
+      }
+    }
+
+    // Same as App::OnUpdate, without waiting for events.
+    perf_overlay.m_Visible = true;
+    auto idle_frame = [&]() {
+      man.ProcessEvents();
+      perf::AllocScope scope(perf::Subsystem::gui);
+      ImGui::NewFrame();
+      menu_bar.OnUpdate(io.DeltaTime);
+      editor.OnUpdate(io.DeltaTime);
+      perf_overlay.OnUpdate(io.DeltaTime);
+      ImGui::Render();
+    };
+    for (int dev = 0; dev < (int)man.m_Devices.size(); dev++) {
+      for (auto& [tab, tab_name] : tabs) {
+        if (!has_tab(man.m_Devices[dev], tab))
+          continue;
+        editor.Select(dev, tab);
+        editor.ShowSwayConfig(true);
+        for (int frame = 0; frame < IDLE_WARMUP; frame++)
+          idle_frame();
+
+        uint64_t allocs = perf::thread_allocs();
+        for (int frame = 0; frame < IDLE_FRAMES; frame++)
+          idle_frame();
+        allocs = perf::thread_allocs() - allocs;
+        suite.Check("idle_frame_allocs", allocs == 0, {
+          {"device_type", GetTypeName(man.m_Devices[dev].type)},
+          {"tab", tab_name},
+          {"allocs", allocs},
+        });
+      }
+    }
+
+    ImGui::DestroyContext();
+    return suite.Finish();
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,64 @@
+/**
+ * @brief Implementation of arena::Arena
+ * @file arena.cpp
+ */
+#include "arena.h"
+#include <algorithm>
+#include <new>
+
+using namespace arena;
+
+static thread_local std::pmr::memory_resource* g_current = nullptr;
+
+std::pmr::memory_resource* arena::current() {
+  return g_current ? g_current : std::pmr::new_delete_resource();
+}
+
+Scope::Scope(std::pmr::memory_resource& resource) : m_prev(g_current) {
+  g_current = &resource;
+}
+
+Scope::~Scope() {
+  g_current = m_prev;
+}
+
+Arena::~Arena() {
+  for (auto& block : m_blocks)
+    ::operator delete(block.data);
+}
+
+size_t Arena::Capacity() const {
+  size_t capacity = 0;
+  for (auto& block : m_blocks)
+    capacity += block.size;
+  return capacity;
+}
+
+void Arena::Reset() {
+  if (m_blocks.size() > 1) {
+    size_t capacity = Capacity();
+    for (auto& block : m_blocks)
+      ::operator delete(block.data);
+    m_blocks = {{(std::byte*)::operator new(capacity), capacity}};
+  }
+  m_offset = 0;
+  m_used = 0;
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) {
+  if (!m_blocks.empty()) {
+    Block& block = m_blocks.back();
+    size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+    if (offset + bytes <= block.size) {
+      m_offset = offset + bytes;
+      m_used += bytes;
+      return block.data + offset;
+    }
+  }
+  // Blocks grow, so that large generations need only a few of them.
+  size_t size = std::max({MIN_BLOCK, bytes + alignment, m_blocks.empty() ? 0 : m_blocks.back().size * 2});
+  m_blocks.push_back({(std::byte*)::operator new(size), size});
+  m_offset = bytes;
+  m_used += bytes;
+  return m_blocks.back().data;
+}
@@ -0,0 +1,104 @@
+/**
+ * @brief Arena for short lived data of a discovery pass.
+ * @file arena.h
+ *
+ * Json DOM of sway replies consists of thousands of small nodes, which
+ * would otherwise be allocated and freed one by one on every discovery.
+ * They are allocated from an Arena instead, which is released in one step
+ * and keeps its memory for the next pass.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace arena {
+  /**
+   * @brief Bump allocator released all at once.
+   *
+   * Memory is handed out from large blocks and deallocation does nothing.
+   * When a generation didn't fit into one block, Reset() replaces the blocks
+   * by a single one big enough for all of them, so generations of similar
+   * size reuse the same block and memory use stays flat.
+   */
+  class Arena : public std::pmr::memory_resource {
+  public:
+    static constexpr size_t MIN_BLOCK = 64 * 1024;
+
+    Arena() = default;
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /// Release everything allocated so far.
+    void Reset();
+    /// Bytes allocated since last Reset().
+    inline size_t Used() const { return m_used; }
+    /// Bytes held in blocks.
+    size_t Capacity() const;
+
+  private:
+    struct Block {
+      std::byte* data;
+      size_t size;
+    };
+    std::vector<Block> m_blocks;
+    size_t m_offset = 0; ///< Free space of the last block starts here
+    size_t m_used = 0;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+      return this == &other;
+    }
+  };
+
+  /// Resource which Allocator takes memory from on this thread.
+  std::pmr::memory_resource* current();
+
+  /**
+   * @brief Make Allocator take memory from `resource` while in scope.
+   *
+   * Everything allocated in the scope must be destroyed before it ends,
+   * because containers may create new allocators to free their memory.
+   */
+  class Scope {
+  public:
+    Scope(std::pmr::memory_resource& resource);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    std::pmr::memory_resource* m_prev;
+  };
+
+  /**
+   * @brief Allocator taking memory from the current() resource.
+   *
+   * Unlike std::pmr::polymorphic_allocator it is default constructible,
+   * which nlohmann::basic_json requires from its allocator.
+   */
+  template <typename T> struct Allocator {
+    using value_type = T;
+    std::pmr::memory_resource* m_Resource;
+
+    Allocator() noexcept : m_Resource(current()) {}
+    template <typename U> Allocator(const Allocator<U>& other) noexcept : m_Resource(other.m_Resource) {}
+
+    T* allocate(size_t n) { return (T*)m_Resource->allocate(n * sizeof(T), alignof(T)); }
+    void deallocate(T* ptr, size_t n) { m_Resource->deallocate(ptr, n * sizeof(T), alignof(T)); }
+    template <typename U> bool operator==(const Allocator<U>& other) const {
+      return m_Resource == other.m_Resource;
+    }
+  };
+
+  /// Json DOM with nodes allocated by Allocator. Strings use the heap, but
+  /// keys and setting values are short enough to be stored inline.
+  using json = nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t,
+                                    std::uint64_t, double, Allocator>;
+}
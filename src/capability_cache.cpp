@@ -0,0 +1,101 @@
+/**
+ * @brief Implementation of CapabilityCache
+ * @file capability_cache.cpp
+ */
+#include "capability_cache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+CapabilityCache::CapabilityCache(std::string path) : m_path(std::move(path)) {}
+
+std::string CapabilityCache::DefaultPath() {
+  std::filesystem::path dir;
+  if (const char* cache = std::getenv("XDG_CACHE_HOME"))
+    dir = cache;
+  else if (const char* home = std::getenv("HOME"))
+    dir = std::filesystem::path(home) / ".cache";
+  else
+    return "";
+  return (dir / "swic" / "capabilities.json").string();
+}
+
+void CapabilityCache::SetVersion(const std::string& version) {
+  m_version = version;
+  m_rejected.clear();
+  m_dirty = false;
+  if (m_path.empty())
+    return;
+
+  std::ifstream file(m_path);
+  if (!file.is_open())
+    return;
+  try {
+    json j = json::parse(file);
+    if (j.value("version", "") != version) {
+      m_dirty = true; // Overwrite stale cache on next save
+      return;
+    }
+    // Settings are stored by name, so that reordering SwaySetting doesn't
+    // invalidate the cache.
+    for (auto& [sway_id, names] : j.at("rejected").items())
+      for (auto& name : names)
+        if (auto setting = GetSetting(name.get<std::string>(), false))
+          m_rejected[sway_id] |= bit(setting.value());
+  } catch (const std::exception&) {
+    m_rejected.clear();
+    m_dirty = true;
+  }
+}
+
+uint32_t CapabilityCache::Rejected(const std::string& sway_id) const {
+  auto it = m_rejected.find(sway_id);
+  return it == m_rejected.end() ? 0 : it->second;
+}
+
+void CapabilityCache::Reject(const std::string& sway_id, SwaySetting setting) {
+  uint32_t& mask = m_rejected[sway_id];
+  if (!(mask & bit(setting))) {
+    mask |= bit(setting);
+    m_dirty = true;
+  }
+}
+
+void CapabilityCache::Forget(const std::string& sway_id) {
+  if (m_rejected.erase(sway_id))
+    m_dirty = true;
+}
+
+bool CapabilityCache::Save() {
+  if (!m_dirty || m_path.empty())
+    return true;
+
+  json rejected = json::object();
+  for (auto& [sway_id, mask] : m_rejected) {
+    json& names = rejected[sway_id] = json::array();
+    for (int s = 0; s < (int)SwaySetting::size; s++)
+      if (mask & bit(SwaySetting(s)))
+        names.push_back(GetSettingName(SwaySetting(s), false));
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(m_path).parent_path(), ec);
+  // Write to temporary file first, so that readers never see partial cache.
+  std::string tmp = m_path + ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::trunc);
+    if (!file.is_open())
+      return false;
+    file << json{{"version", m_version}, {"rejected", rejected}}.dump(2) << '\n';
+    if (!file)
+      return false;
+  }
+  if (std::rename(tmp.c_str(), m_path.c_str()) != 0)
+    return false;
+  m_dirty = false;
+  return true;
+}
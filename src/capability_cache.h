@@ -0,0 +1,63 @@
+/**
+ * @brief Remembers settings sway rejected for each device.
+ * @file capability_cache.h
+ *
+ * Not every device supports every setting (e.g. `dwtp` on a mouse) and
+ * older sway versions don't know some of them at all. Settings rejected by
+ * sway are recorded per device and are not sent again. The cache is tied to
+ * the version of sway it was learned from and is stored in
+ * `$XDG_CACHE_HOME/swic`, so it survives restarts.
+ */
+#pragma once
+#include "device_manager.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+class CapabilityCache {
+  static_assert((int)SwaySetting::size <= 32, "Rejected settings must fit into uint32_t");
+public:
+  /**
+   * @brief Create cache persisted at given path.
+   * @param path File to load from and save to. Not persisted if empty.
+   */
+  CapabilityCache(std::string path = "");
+
+  /// `$XDG_CACHE_HOME/swic/capabilities.json` or empty if there is no cache directory.
+  static std::string DefaultPath();
+  inline const std::string& Path() const { return m_path; }
+
+  /**
+   * @brief Set version of running sway.
+   *
+   * Loads the cache from Path() and drops it if it was learned from
+   * a different version, since the set of supported settings may differ.
+   */
+  void SetVersion(const std::string& version);
+  inline const std::string& Version() const { return m_version; }
+
+  /// Return TRUE unless sway rejected the setting for the device before.
+  inline bool Supported(const std::string& sway_id, SwaySetting setting) const {
+    return !(Rejected(sway_id) & bit(setting));
+  }
+  /// Bit mask of settings (`1 << SwaySetting`) rejected for the device.
+  uint32_t Rejected(const std::string& sway_id) const;
+  /// Record that sway rejected the setting.
+  void Reject(const std::string& sway_id, SwaySetting setting);
+  /// Forget rejected settings of the device, so that they are tried again.
+  void Forget(const std::string& sway_id);
+
+  /**
+   * @brief Write the cache to Path() if it changed since last save.
+   * @return FALSE on failure.
+   */
+  bool Save();
+
+  static inline uint32_t bit(SwaySetting setting) { return 1u << (int)setting; }
+
+private:
+  std::string m_path;
+  std::string m_version;
+  std::unordered_map<std::string, uint32_t> m_rejected;
+  bool m_dirty = false;
+};
@@ -3,10 +3,19 @@
  */
 #include "config.h"
 #include <fstream>
+#include <iostream>
 #include <sstream>
+#include <cerrno>
 #include <cstdlib> // std::getenv
+#include <cstring>
 #include <filesystem>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
 namespace ImWrap {
   void to_json(json_t& json, const ImWrap::ContextDefinition& def) {
     json["window_width"] = def.window_width;
@@ -37,11 +46,34 @@ void to_json(json_t& json, const AppConfiguration& config) {
   json["safe_mode"] = config.safe_mode;
   json["swaymsg_path"] = config.swaymsg_path;
   json["revert_timeout"] = config.revert_timeout;
+  json["native_ipc"] = config.native_ipc;
+  json["idle_rendering"] = config.idle_rendering;
+  json["xkb_rules"] = config.xkb_rules;
+  json["import_sway_config"] = config.import_sway_config;
+  json["sway_config"] = config.sway_config;
+  json["managed_config"] = config.managed_config;
+  json["capability_cache"] = config.capability_cache;
+  json["preset_library"] = config.preset_library;
+  json["attach_daemon"] = config.attach_daemon;
+  json["single_instance"] = config.single_instance;
+  json["ipc_timeout"] = config.ipc_timeout;
 }
 void from_json(const json_t& json, AppConfiguration& config) {
-  json["safe_mode"].get_to(config.safe_mode);
-  json["swaymsg_path"].get_to(config.swaymsg_path);
-  json["revert_timeout"].get_to(config.revert_timeout);
+  json.at("safe_mode").get_to(config.safe_mode);
+  json.at("swaymsg_path").get_to(config.swaymsg_path);
+  json.at("revert_timeout").get_to(config.revert_timeout);
+  // Options added in later versions may be missing in older configs.
+  config.native_ipc = json.value("native_ipc", config.native_ipc);
+  config.idle_rendering = json.value("idle_rendering", config.idle_rendering);
+  config.xkb_rules = json.value("xkb_rules", config.xkb_rules);
+  config.import_sway_config = json.value("import_sway_config", config.import_sway_config);
+  config.sway_config = json.value("sway_config", config.sway_config);
+  config.managed_config = json.value("managed_config", config.managed_config);
+  config.capability_cache = json.value("capability_cache", config.capability_cache);
+  config.preset_library = json.value("preset_library", config.preset_library);
+  config.attach_daemon = json.value("attach_daemon", config.attach_daemon);
+  config.single_instance = json.value("single_instance", config.single_instance);
+  config.ipc_timeout = json.value("ipc_timeout", config.ipc_timeout);
 }
 
 void to_json(json_t& json, const Configuration& config) {
@@ -49,8 +81,8 @@ void to_json(json_t& json, const Configuration& config) {
   json["app"] = config.app;
 }
 void from_json(const json_t& json, Configuration& config) {
-  json["imwrap"].get_to(config.imwrap);
-  json["app"].get_to(config.app);
+  json.at("imwrap").get_to(config.imwrap);
+  json.at("app").get_to(config.app);
 }
 
 static auto g_env_config = std::getenv("XDG_CONFIG_HOME");
@@ -62,8 +94,18 @@ inline auto get_config_dir() {
   return std::filesystem::path(g_env_config ? g_env_config : "~") / CONFIG_DIR;
 }
 
+// Hash of the serialized configuration last loaded or saved.
+static std::optional<size_t> g_config_hash;
+
+inline size_t config_hash(const std::string& content) {
+  return std::hash<std::string>()(content);
+}
+
 bool save_config(const Configuration& config) {
-  json_t json = config;
+  std::string content = json_t(config).dump(2);
+  size_t hash = config_hash(content);
+  if (g_config_hash == hash)
+    return true;
 
   // Create all direcotires until config if needed.
   auto config_dir = get_config_dir();
@@ -71,12 +113,42 @@ bool save_config(const Configuration& config) {
     std::filesystem::create_directories(config_dir);
   }
 
-  std::ofstream stream(get_config_path());
-  if (!stream.is_open()) {
+  // Write temporary file and rename it over the config, so that crash
+  // never leaves partially written config behind. Symlinked config stays a
+  // symlink, the file it points to is replaced. Temporary file is unique,
+  // other instances may save at the same time.
+  std::string path = get_config_path().string();
+  if (char* real = realpath(path.c_str(), nullptr)) {
+    path = real;
+    std::free(real);
+  }
+  std::string tmp = path + ".XXXXXX";
+  int fd = mkstemp(tmp.data());
+  if (fd < 0)
+    return false;
+  // New file gets the mode of the one it replaces.
+  struct stat st;
+  fchmod(fd, stat(path.c_str(), &st) == 0 ? st.st_mode & 07777 : 0644);
+  size_t written = 0;
+  while (written < content.size()) {
+    ssize_t n = write(fd, content.data() + written, content.size() - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      close(fd);
+      unlink(tmp.c_str());
+      return false;
+    }
+    written += n;
+  }
+  fsync(fd);
+  close(fd);
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
     return false;
   }
-  stream << json.dump(2);
 
+  g_config_hash = hash;
   return true;
 }
 
@@ -88,6 +160,78 @@ std::optional<Configuration> load_config() {
   json_t json;
   stream >> json;
 
-  return json.get<Configuration>();
+  auto config = json.get<Configuration>();
+  g_config_hash = config_hash(json_t(config).dump(2));
+  return config;
+}
+
+ConfigWatcher::ConfigWatcher(std::function<void()> on_change) : m_onChange(std::move(on_change)) {
+  std::error_code ec;
+  std::filesystem::create_directories(get_config_dir(), ec);
+  m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_fd < 0)
+    return;
+  // The file itself may be replaced, so its directory is watched.
+  if (inotify_add_watch(m_fd, get_config_dir().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    close(m_fd);
+    m_fd = -1;
+    return;
+  }
+  m_thread = std::thread(&ConfigWatcher::run, this);
+}
+
+ConfigWatcher::~ConfigWatcher() {
+  m_stop.Signal();
+  if (m_thread.joinable())
+    m_thread.join();
+  if (m_fd >= 0)
+    close(m_fd);
+}
+
+void ConfigWatcher::run() {
+  alignas(inotify_event) char buf[4096];
+  while (true) {
+    pollfd fds[] = {{m_fd, POLLIN, 0}, {m_stop.Fd(), POLLIN, 0}};
+    if (poll(fds, 2, -1) <= 0)
+      continue;
+    if (fds[1].revents)
+      return;
+    ssize_t n;
+    bool changed = false;
+    while ((n = read(m_fd, buf, sizeof(buf))) > 0) {
+      for (ssize_t i = 0; i < n;) {
+        auto* event = (const inotify_event*)(buf + i);
+        if (event->len > 0 && std::strcmp(event->name, CONFIG_FILE) == 0)
+          changed = true;
+        i += sizeof(inotify_event) + event->len;
+      }
+    }
+    if (changed) {
+      m_changed = true;
+      if (m_onChange)
+        m_onChange();
+    }
+  }
+}
+
+std::optional<Configuration> ConfigWatcher::Poll() {
+  if (!m_changed.exchange(false))
+    return {};
+  std::ifstream stream(get_config_path());
+  if (!stream.is_open())
+    return {};
+  try {
+    json_t json;
+    stream >> json;
+    auto config = json.get<Configuration>();
+    size_t hash = config_hash(json_t(config).dump(2));
+    if (g_config_hash == hash)
+      return {};
+    g_config_hash = hash;
+    return config;
+  } catch (const std::exception& e) {
+    std::cerr << "Ignoring invalid " << get_config_path().string() << ": " << e.what() << std::endl;
+    return {};
+  }
 }
 
@@ -5,7 +5,12 @@
 #pragma once
 #include <nlohmann/json.hpp>
 #include <imguiwrapper.hpp>
+#include <atomic>
+#include <functional>
 #include <optional>
+#include <thread>
+#include "stop_event.h"
+#include "xkb_catalogue.h"
 
 /// Name of the directory in which the configuration is stored.
 #define CONFIG_DIR "swic"
@@ -18,6 +23,17 @@ struct AppConfiguration {
   bool safe_mode = true;    ///< Revert changes after a while if not confirmed
   std::string swaymsg_path = "swaymsg";   ///< Path to swaymsg executable
   float revert_timeout = 10.0f;   ///< Number of seconds to revert changes after (in safe mode)
+  bool native_ipc = true;   ///< Talk to sway over $SWAYSOCK instead of calling swaymsg
+  bool idle_rendering = true;   ///< Redraw only on input or events instead of continuously
+  std::string xkb_rules = xkb::DEFAULT_RULES;   ///< xkb rules registry with layouts and options
+  bool import_sway_config = true;   ///< Read settings sway doesn't report from its config
+  std::string sway_config = "";   ///< Sway config to import, the one loaded by sway if empty
+  std::string managed_config = "";   ///< Include file with saved input blocks, default if empty
+  bool capability_cache = true;   ///< Remember settings sway rejected across runs
+  std::string preset_library = "";   ///< Preset library to seed device settings from, default if empty
+  bool attach_daemon = true;   ///< Read devices from running `swic --daemon` instead of sway
+  bool single_instance = true;   ///< Raise the running editor instead of starting another one
+  float ipc_timeout = 2.0f;   ///< Number of seconds after which a request to sway fails
 };
 
 /// All configuration data.
@@ -30,7 +46,8 @@ struct Configuration {
  * @brief Save configuration data to disk.
  *
  * Save configuration to disk. It will be located in `XDG_CONFIG_HOME`
- * or `~` if not defined.
+ * or `~` if not defined. The file is replaced by atomic rename and only if
+ * the configuration differs from the one last loaded or saved.
  *
  * @param def ImWrap context configuration
  * @return TRUE on success FALSE on failure.
@@ -43,3 +60,36 @@ bool save_config(const Configuration& def);
  */
 std::optional<Configuration> load_config();
 
+/**
+ * @brief Reloads configuration when the file changes on disk.
+ *
+ * Directory of the config is watched by inotify on a background thread, so
+ * replacing the file by rename (as save_config() and many editors do) is
+ * noticed too. Configuration equal to the one last loaded or saved, e.g.
+ * written by save_config() itself, is not reported.
+ */
+class ConfigWatcher {
+public:
+  /// @param on_change Called from the background thread when the file changes.
+  ConfigWatcher(std::function<void()> on_change);
+  ~ConfigWatcher();
+  ConfigWatcher(const ConfigWatcher&) = delete;
+  ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+  /**
+   * @brief Configuration changed since the last call.
+   *
+   * Invalid file (e.g. saved in the middle of editing) is reported to
+   * stderr and ignored until it changes again.
+   */
+  std::optional<Configuration> Poll();
+
+private:
+  int m_fd{-1};
+  std::function<void()> m_onChange;
+  StopEvent m_stop;
+  std::atomic<bool> m_changed{false};
+  std::thread m_thread;
+
+  void run();
+};
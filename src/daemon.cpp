@@ -0,0 +1,300 @@
+/**
+ * @brief Implementation of Daemon and DaemonTransport
+ * @file daemon.cpp
+ */
+#include "daemon.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Daemon::Daemon(std::unique_ptr<ipc::Transport> transport) : m_transport(std::move(transport)) {
+  SharedState::PrivateRuntimeDir();
+  std::string path = SocketPath();
+  if (int fd = ipc::connect_socket(path); fd >= 0) {
+    close(fd);
+    throw std::runtime_error("swic daemon is already running (" + path + ").");
+  }
+  if (dynamic_cast<ipc::SocketTransport*>(m_transport.get()))
+    if (const char* sock = std::getenv("SWAYSOCK"))
+      m_sway = sock;
+
+  if (pipe2(m_wakeFds, O_CLOEXEC | O_NONBLOCK) < 0)
+    throw std::runtime_error("Failed to create pipe.");
+
+  publish();
+
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("Socket path is too long: " + path);
+  path.copy(addr.sun_path, path.size());
+  // Socket of a daemon which didn't exit cleanly.
+  unlink(path.c_str());
+  m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (m_listenFd < 0 || bind(m_listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(m_listenFd, 16) < 0) {
+    if (m_listenFd >= 0)
+      close(m_listenFd);
+    m_listenFd = -1;
+    std::remove(SharedState::DefaultPath().c_str());
+    throw std::runtime_error("Failed to listen on " + path);
+  }
+
+  m_events = std::make_unique<ipc::EventPump>(*m_transport, R"(["input", "output"])", [this]() {
+    char c = 0;
+    [[maybe_unused]] ssize_t n = write(m_wakeFds[1], &c, 1);
+  });
+}
+
+Daemon::~Daemon() {
+  m_events.reset();
+  for (int fd : m_wakeFds)
+    if (fd >= 0)
+      close(fd);
+  if (m_listenFd >= 0) {
+    close(m_listenFd);
+    unlink(SocketPath().c_str());
+    std::remove(SharedState::DefaultPath().c_str());
+  }
+}
+
+std::string Daemon::SocketPath() {
+  return (std::filesystem::path(SharedState::RuntimeDir()) / "daemon.sock").string();
+}
+
+void Daemon::Run() {
+  // Commands are usually followed by an input event, which publishes the
+  // new state right away. Without events it is published once the commands
+  // stop coming for a while. Otherwise there is nothing to time out.
+  constexpr int DIRTY_TIMEOUT_MS = 20;
+
+  std::vector<pollfd> fds;
+  std::vector<Client> clients;
+  while (!m_stop.Signaled()) {
+    fds.assign({{m_listenFd, POLLIN, 0}, {m_wakeFds[0], POLLIN, 0}, {m_stop.Fd(), POLLIN, 0}});
+    for (auto& client : clients)
+      fds.push_back({client.fd, short(client.out.empty() ? POLLIN : POLLIN | POLLOUT), 0});
+    int ready = poll(fds.data(), fds.size(), m_dirty ? DIRTY_TIMEOUT_MS : -1);
+    if (ready == 0 && m_dirty)
+      tryPublish();
+    if (ready <= 0 || fds[2].revents)
+      continue;
+
+    if (fds[1].revents & POLLIN) {
+      char buf[64];
+      while (read(m_wakeFds[0], buf, sizeof(buf)) > 0) {}
+      auto events = m_events->Poll();
+      // Instances handling the event read the state from the snapshot.
+      if (!events.empty())
+        tryPublish();
+      for (auto& msg : events)
+        for (auto& client : clients)
+          if (client.subscribed)
+            client.queue(msg.type, msg.payload);
+    }
+
+    for (size_t i = 0; i < clients.size(); i++) {
+      Client& client = clients[i];
+      if (fds[i + 3].revents & (POLLIN | POLLHUP | POLLERR))
+        if (!client.receive() || !serve(client))
+          client.failed = true;
+      if (!client.failed && !client.out.empty())
+        client.failed = !client.flush();
+    }
+    std::erase_if(clients, [](const Client& client) {
+      if (client.failed)
+        close(client.fd);
+      return client.failed;
+    });
+
+    if (fds[0].revents & POLLIN) {
+      int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+      if (fd >= 0)
+        clients.emplace_back().fd = fd;
+    }
+  }
+
+  for (auto& client : clients)
+    close(client.fd);
+}
+
+bool Daemon::serve(Client& client) {
+  while (client.in.size() >= ipc::HEADER_SIZE) {
+    uint32_t len, type;
+    if (!ipc::decode_header(client.in.data(), len, type) || len > Client::MAX_BUFFERED)
+      return false;
+    if (client.in.size() < ipc::HEADER_SIZE + len)
+      return true;
+    std::string payload = client.in.substr(ipc::HEADER_SIZE, len);
+    client.in.erase(0, ipc::HEADER_SIZE + len);
+
+    std::string reply;
+    if (type == uint32_t(ipc::MsgType::subscribe)) {
+      client.subscribed = true;
+      reply = R"({"success": true})";
+    } else {
+      try {
+        reply = handle(ipc::MsgType(type), payload);
+      } catch (const ipc::TimeoutError& e) {
+        // Instance sees the connection closed instead of waiting for its
+        // own deadline.
+        std::cerr << e.what() << std::endl;
+        return false;
+      }
+    }
+    if (!client.queue(type, reply))
+      return false;
+  }
+  return true;
+}
+
+bool Daemon::Client::receive() {
+  char buf[4096];
+  while (in.size() <= MAX_BUFFERED) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n > 0)
+      in.append(buf, n);
+    else if (n == 0)
+      return false;
+    else if (errno != EINTR)
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+  }
+  return false;
+}
+
+bool Daemon::Client::queue(uint32_t type, std::string_view payload) {
+  out += ipc::encode(type, payload);
+  return out.size() <= MAX_BUFFERED;
+}
+
+bool Daemon::Client::flush() {
+  while (!out.empty()) {
+    ssize_t n = write(fd, out.data(), out.size());
+    if (n > 0)
+      out.erase(0, n);
+    else if (n < 0 && errno != EINTR)
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+  }
+  return true;
+}
+
+void Daemon::publish() {
+  auto inputs = m_transport->Submit(ipc::MsgType::get_inputs, "");
+  auto outputs = m_transport->Submit(ipc::MsgType::get_outputs, "");
+  m_inputs = m_transport->Wait(inputs);
+  m_outputs = m_transport->Wait(outputs);
+  SharedState::Write(SharedState::DefaultPath(), ++m_generation, m_sway, m_inputs, m_outputs);
+  m_dirty = false;
+}
+
+void Daemon::tryPublish() {
+  try {
+    publish();
+  } catch (const ipc::TimeoutError& e) {
+    // Snapshot stays dirty, so it is published again shortly.
+    std::cerr << e.what() << std::endl;
+    m_dirty = true;
+  }
+}
+
+std::string Daemon::handle(ipc::MsgType type, const std::string& payload) {
+  switch (type) {
+  case ipc::MsgType::get_inputs:
+    return m_inputs;
+  case ipc::MsgType::get_outputs:
+    return m_outputs;
+  case ipc::MsgType::get_version:
+    if (m_version.empty())
+      m_version = m_transport->Request(type, payload);
+    return m_version;
+  default:
+    m_dirty |= type == ipc::MsgType::run_command;
+    return m_transport->Request(type, payload);
+  }
+}
+
+DaemonTransport::DaemonTransport(std::unique_ptr<ipc::SocketTransport> inner,
+                                 const std::string& state_path)
+  : m_inner(std::move(inner))
+  , m_statePath(state_path)
+{}
+
+std::unique_ptr<DaemonTransport> DaemonTransport::Attach() {
+  std::string state_path = SharedState::DefaultPath();
+  try {
+    // Snapshot and socket of another user are never trusted.
+    SharedState::PrivateRuntimeDir();
+    SharedState state(state_path);
+    const char* sock = std::getenv("SWAYSOCK");
+    if (!state.Alive() || state.Sway() != (sock ? sock : ""))
+      return nullptr;
+    auto inner = std::make_unique<ipc::SocketTransport>(Daemon::SocketPath());
+    return std::unique_ptr<DaemonTransport>(new DaemonTransport(std::move(inner), state_path));
+  } catch (const std::runtime_error&) {
+    return nullptr;
+  }
+}
+
+std::string DaemonTransport::Request(ipc::MsgType type, const std::string& payload) {
+  if (auto reply = snapshotReply(type))
+    return std::move(reply.value());
+  return m_inner->Request(type, payload);
+}
+
+ipc::Transport::Ticket DaemonTransport::Submit(ipc::MsgType type, const std::string& payload) {
+  Pending pending;
+  pending.reply = snapshotReply(type);
+  if (!pending.reply)
+    pending.inner = m_inner->Submit(type, payload);
+  m_pending.emplace(m_next, std::move(pending));
+  return m_next++;
+}
+
+std::string DaemonTransport::Wait(Ticket ticket) {
+  auto it = m_pending.find(ticket);
+  if (it == m_pending.end())
+    throw std::runtime_error("No reply for request " + std::to_string(ticket) + ".");
+  Pending pending = std::move(it->second);
+  m_pending.erase(it);
+  if (pending.reply)
+    return std::move(pending.reply.value());
+  return m_inner->Wait(pending.inner);
+}
+
+bool DaemonTransport::Ready(Ticket ticket) {
+  auto it = m_pending.find(ticket);
+  if (it == m_pending.end())
+    return false;
+  return it->second.reply || m_inner->Ready(it->second.inner);
+}
+
+bool DaemonTransport::Subscribe(const std::string& events) {
+  return m_inner->Subscribe(events);
+}
+
+std::optional<ipc::Message> DaemonTransport::NextEvent(int stop_fd) {
+  return m_inner->NextEvent(stop_fd);
+}
+
+void DaemonTransport::SetTimeout(std::chrono::milliseconds timeout) {
+  Transport::SetTimeout(timeout);
+  m_inner->SetTimeout(timeout);
+}
+
+std::optional<std::string> DaemonTransport::snapshotReply(ipc::MsgType type) {
+  if (type != ipc::MsgType::get_inputs && type != ipc::MsgType::get_outputs)
+    return {};
+  // Mapped again for every request, the daemon replaces the file on changes.
+  SharedState state(m_statePath);
+  return std::string(type == ipc::MsgType::get_inputs ? state.Inputs() : state.Outputs());
+}
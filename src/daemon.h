@@ -0,0 +1,135 @@
+/**
+ * @brief Background swic instance sharing device state with other instances.
+ * @file daemon.h
+ *
+ * `swic --daemon` stays connected to sway, keeps the shared state snapshot
+ * (see shared_state.h) up to date and serves the sway IPC protocol on a
+ * socket in SharedState::RuntimeDir(). Instances attached to it by
+ * DaemonTransport read devices and outputs from the snapshot, so opening
+ * the editor sends no request to sway. Other requests (commands) are
+ * forwarded to sway and sway events are forwarded to subscribed instances.
+ */
+#pragma once
+#include "shared_state.h"
+#include "stop_event.h"
+#include "sway_ipc.h"
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/// Background instance publishing device state and forwarding requests to sway.
+class Daemon {
+public:
+  /**
+   * @param transport Connection to sway.
+   * @exception std::runtime_error When a daemon is already running, sway
+   *            can't be queried, the runtime directory isn't private or the
+   *            socket can't be created.
+   */
+  Daemon(std::unique_ptr<ipc::Transport> transport);
+  ~Daemon();
+  Daemon(const Daemon&) = delete;
+  Daemon& operator=(const Daemon&) = delete;
+
+  /// Socket of the daemon in SharedState::RuntimeDir().
+  static std::string SocketPath();
+
+  /**
+   * @brief Serve other instances until Stop().
+   *
+   * Requests sway doesn't reply to in time fail for the requesting instance
+   * only, the daemon keeps running. Instances which stop reading their
+   * replies and events are dropped. Idle daemon blocks until an instance,
+   * sway or Stop() wakes it.
+   * @exception std::runtime_error When the connection to sway fails.
+   */
+  void Run();
+  /// Make Run() return. Can be called from any thread or a signal handler.
+  inline void Stop() { m_stop.Signal(); }
+
+private:
+  /**
+   * @brief Attached instance. Its socket is non-blocking, so an instance
+   *        which stops reading or writing never stalls the others.
+   */
+  struct Client {
+    /// Instance is dropped when it leaves more than this unread or unsent.
+    static constexpr size_t MAX_BUFFERED = 16 << 20;
+
+    int fd = -1;
+    std::string in;  ///< Received part of the next requests
+    std::string out; ///< Replies and events not written yet
+    bool subscribed = false;
+    bool failed = false; ///< Closed, misbehaving or too slow, to be dropped
+
+    /// Read what is available. FALSE if closed or failed.
+    bool receive();
+    /// Append message to `out`. FALSE if too much is queued.
+    bool queue(uint32_t type, std::string_view payload);
+    /// Write as much of `out` as the socket takes. FALSE on failure.
+    bool flush();
+  };
+
+  std::unique_ptr<ipc::Transport> m_transport;
+  // Receives events from m_transport. Must be destroyed before it.
+  std::unique_ptr<ipc::EventPump> m_events;
+  std::string m_sway;    ///< $SWAYSOCK if connected over the socket
+  std::string m_inputs;  ///< Last reply to get_inputs
+  std::string m_outputs; ///< Last reply to get_outputs
+  std::string m_version; ///< Reply to get_version, requested once
+  uint64_t m_generation = 0;
+  bool m_dirty = false;  ///< Commands were run since the last publish()
+  int m_listenFd = -1;
+  int m_wakeFds[2] = {-1, -1}; ///< Pipe waking Run() when an event arrives
+  StopEvent m_stop;
+
+  /// Query devices and outputs and replace the snapshot.
+  void publish();
+  /// publish(), keeping the old snapshot if sway doesn't reply in time.
+  void tryPublish();
+  /**
+   * @brief Queue replies to complete requests received from the instance.
+   * @return FALSE if the instance must be dropped.
+   */
+  bool serve(Client& client);
+  /// Reply to a request of an attached instance.
+  std::string handle(ipc::MsgType type, const std::string& payload);
+};
+
+/**
+ * @brief Transport of an instance attached to a running daemon.
+ *
+ * `get_inputs` and `get_outputs` are answered from the latest snapshot
+ * without any round trip, everything else goes through the daemon socket.
+ */
+class DaemonTransport : public ipc::Transport {
+public:
+  /// Attach to daemon connected to the same sway. Empty if none is running.
+  static std::unique_ptr<DaemonTransport> Attach();
+
+  std::string Request(ipc::MsgType type, const std::string& payload) override;
+  Ticket Submit(ipc::MsgType type, const std::string& payload) override;
+  std::string Wait(Ticket ticket) override;
+  bool Ready(Ticket ticket) override;
+  bool Subscribe(const std::string& events) override;
+  std::optional<ipc::Message> NextEvent(int stop_fd) override;
+  void SetTimeout(std::chrono::milliseconds timeout) override;
+
+private:
+  /// Request answered from the snapshot or sent to the daemon.
+  struct Pending {
+    std::optional<std::string> reply; ///< Set if answered from the snapshot
+    Ticket inner = 0;                 ///< Ticket of m_inner otherwise
+  };
+
+  std::unique_ptr<ipc::SocketTransport> m_inner;
+  std::string m_statePath;
+  Ticket m_next = 0;
+  std::unordered_map<Ticket, Pending> m_pending;
+
+  DaemonTransport(std::unique_ptr<ipc::SocketTransport> inner, const std::string& state_path);
+  /// Reply from the latest snapshot, empty if it isn't a snapshot request.
+  std::optional<std::string> snapshotReply(ipc::MsgType type);
+};
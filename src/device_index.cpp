@@ -0,0 +1,57 @@
+/**
+ * @brief Implementation of DeviceIndex
+ * @file device_index.cpp
+ */
+#include "device_index.h"
+#include <cctype>
+
+static std::string to_lower(std::string_view str) {
+  std::string out(str);
+  for (char& c : out)
+    c = std::tolower((unsigned char)c);
+  return out;
+}
+
+void DeviceIndex::Update(const DeviceMan& manager) {
+  if (manager.Generation() == m_generation)
+    return;
+  m_generation = manager.Generation();
+
+  m_haystacks.clear();
+  m_haystacks.reserve(manager.m_Devices.size());
+  for (auto& dev : manager.m_Devices)
+    m_haystacks.push_back(to_lower(dev.name + "\n" + dev.sway_id + "\ntype:" + GetTypeName(dev.type)));
+
+  m_results.resize(m_haystacks.size());
+  for (int i = 0; i < (int)m_results.size(); i++)
+    m_results[i] = i;
+  narrow(m_query);
+}
+
+const std::vector<int>& DeviceIndex::Filter(std::string_view query) {
+  std::string lower = to_lower(query);
+  // Every word of the previous query is contained in a word of the new one,
+  // so the new results are a subset of the previous ones.
+  if (lower.compare(0, m_query.size(), m_query) != 0) {
+    m_results.resize(m_haystacks.size());
+    for (int i = 0; i < (int)m_results.size(); i++)
+      m_results[i] = i;
+  }
+  m_query = std::move(lower);
+  narrow(m_query);
+  return m_results;
+}
+
+void DeviceIndex::narrow(std::string_view query) {
+  size_t start = 0;
+  while (start < query.size()) {
+    size_t end = std::min(query.find(' ', start), query.size());
+    std::string_view word = query.substr(start, end - start);
+    start = end + 1;
+    if (word.empty())
+      continue;
+    std::erase_if(m_results, [&](int i) {
+      return m_haystacks[i].find(word) == std::string::npos;
+    });
+  }
+}
@@ -0,0 +1,39 @@
+/**
+ * @brief Incremental search over devices managed by DeviceMan.
+ * @file device_index.h
+ */
+#pragma once
+#include "device_manager.h"
+#include <string_view>
+
+/**
+ * @brief Filters devices by name, sway_id and type.
+ *
+ * Every device is indexed as one lowercase string containing its name,
+ * sway_id and `type:<type>`. Query is split into words, all of which have to
+ * be contained in the string, so e.g. `wacom type:pad` matches pads of Wacom
+ * tablets. When the query only narrows the previous one (user keeps typing),
+ * only previous results are searched.
+ */
+class DeviceIndex {
+public:
+  /// Rebuild the index and filter again if devices of the manager changed.
+  void Update(const DeviceMan& manager);
+
+  /**
+   * @brief Filter devices by query.
+   * @return Indices into DeviceMan::m_Devices in their original order.
+   */
+  const std::vector<int>& Filter(std::string_view query);
+  /// Result of the last Filter() or all devices.
+  inline const std::vector<int>& Results() const { return m_results; }
+
+private:
+  std::vector<std::string> m_haystacks;
+  std::vector<int> m_results;
+  std::string m_query;
+  uint64_t m_generation = UINT64_MAX;
+
+  /// Keep results containing all words of the (lowercase) query.
+  void narrow(std::string_view query);
+};
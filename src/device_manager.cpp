@@ -3,49 +3,105 @@
  * @file device_manager.cpp
  */
 #include "device_manager.h"
-#include <cstdlib> // system()
+#include "arena.h"
+#include "capability_cache.h"
+#include "perf.h"
+#include "preset_library.h"
+#include "sway_format.h"
 #include <exception>
-#include <sstream>
-#include <stdio.h>
+#include <iostream>
+#include <unistd.h>
 
 #include <nlohmann/json.hpp>
-#include <sstream>
 using json = nlohmann::json;
 
-DeviceMan::DeviceMan(std::string swaymsg_path) : m_swaymsg(swaymsg_path) {
+DeviceMan::DeviceMan(std::unique_ptr<ipc::Transport> transport)
+  : m_transport(std::move(transport))
+  , m_arena(std::make_unique<arena::Arena>())
+  , m_capabilities(std::make_unique<CapabilityCache>())
+  , m_presets(std::make_unique<PresetLibrary>())
+{
   parseSwaymsg();
   m_backupDevices = m_Devices;
 }
 
+DeviceMan::DeviceMan(std::string swaymsg_path)
+  : DeviceMan(std::make_unique<ipc::SwaymsgTransport>(swaymsg_path)) {}
+
 DeviceMan::~DeviceMan() {}
 
-// Read swaymsg outout into nlohmann::json structure.
-void read_swaymsg(json& out, FILE* swaymsg_fp) {
-  std::stringstream sstr;
-  char line[256];
-  while (fgets(line, sizeof(line), swaymsg_fp) != NULL) {
-    std::string line_s(line);
-    sstr << line_s;
+std::string DeviceMan::request(ipc::MsgType type, const std::string& payload) {
+  perf::stats().ipc_requests.Add();
+  perf::stats().ipc_bytes_out.Add(ipc::HEADER_SIZE + payload.size());
+  uint64_t start = perf::now_us();
+  std::string reply;
+  try {
+    reply = m_transport->Request(type, payload);
+  } catch (const ipc::TimeoutError&) {
+    perf::stats().ipc_timeouts.Add();
+    throw;
+  }
+  recordLatency(type, start);
+  perf::stats().ipc_bytes_in.Add(ipc::HEADER_SIZE + reply.size());
+  return reply;
+}
+
+ipc::Transport::Ticket DeviceMan::submit(ipc::MsgType type, const std::string& payload) {
+  perf::stats().ipc_requests.Add();
+  perf::stats().ipc_bytes_out.Add(ipc::HEADER_SIZE + payload.size());
+  try {
+    return m_transport->Submit(type, payload);
+  } catch (const ipc::TimeoutError&) {
+    perf::stats().ipc_timeouts.Add();
+    throw;
+  }
+}
+
+std::string DeviceMan::wait(ipc::Transport::Ticket ticket, ipc::MsgType type) {
+  uint64_t start = perf::now_us();
+  std::string reply;
+  try {
+    reply = m_transport->Wait(ticket);
+  } catch (const ipc::TimeoutError&) {
+    perf::stats().ipc_timeouts.Add();
+    throw;
+  }
+  recordLatency(type, start);
+  perf::stats().ipc_bytes_in.Add(ipc::HEADER_SIZE + reply.size());
+  return reply;
+}
+
+void DeviceMan::recordLatency(ipc::MsgType type, uint64_t start) {
+  uint64_t us = perf::now_us() - start;
+  perf::stats().ipc_latency.Record(us);
+  if (us < perf::SLOW_REQUEST_US)
+    return;
+  perf::stats().ipc_slow.Add();
+  std::cerr << "Slow reply of sway to " << ipc::GetMsgTypeName(type) << ": " << us / 1000
+            << " ms" << std::endl;
+}
+
+void DeviceMan::probeVersion() {
+  if (m_versionProbed)
+    return;
+  m_versionProbed = true;
+  try {
+    json version = json::parse(request(ipc::MsgType::get_version));
+    m_swayVersion = version.value("human_readable", "");
+    m_loadedConfig = version.value("loaded_config_file_name", "");
+  } catch (const std::exception&) {
+    // Older sway, recording without GET_VERSION...
   }
-  sstr >> out;
 }
 
-// Read swaymsg -t get_inputs --raw output into json.
-void get_inputs_json(json& out, std::string swaymsg_path) {
-  FILE* fp = popen((swaymsg_path + " -t get_inputs --raw").c_str(), "r");
-  if (!fp)
-    throw std::runtime_error("Failed to call swaymsg.");
-  read_swaymsg(out, fp);
-  pclose(fp);
+const std::string& DeviceMan::SwayVersion() {
+  probeVersion();
+  return m_swayVersion;
 }
 
-// Read swaymsg -t get_outputs --raw output into json.
-void get_outputs_json(json& out, std::string swaymsg_path) {
-  FILE* fp = popen((swaymsg_path + " -t get_outputs --raw").c_str(), "r");
-  if (!fp)
-    throw std::runtime_error("Failed to call swaymsg.");
-  read_swaymsg(out, fp);
-  pclose(fp);
+void DeviceMan::LoadCapabilities(const std::string& path) {
+  m_capabilities = std::make_unique<CapabilityCache>(path);
+  m_capabilities->SetVersion(SwayVersion());
 }
 
 // String to boolean
@@ -54,7 +110,7 @@ inline bool stb(const std::string& s) { return s == "enabled" ? true : false; }
 inline std::string bts(bool b) { return b ? "enabled" : "disabled"; }
 
 // Convert json block to Device.
-void from_json(const json& j, Opt<Device>& device) {
+template <typename Json> void from_json(const Json& j, Opt<Device>& device) {
   // Parse type and if it should be skipped then skip it.
   std::string type;
   j.at("type").get_to(type);
@@ -74,22 +130,22 @@ void from_json(const json& j, Opt<Device>& device) {
   if (d.type == DevType::touchpad || d.type == DevType::pointer) {
     if (j.contains(GetSettingName(SwaySetting::scroll_factor)))
       d.scroll_factor =
-          j[GetSettingName(SwaySetting::scroll_factor)].get<float>();
+          j[GetSettingName(SwaySetting::scroll_factor)].template get<float>();
   } else if (d.type == DevType::keyboard) {
     if (j.contains(GetSettingName(SwaySetting::repeat_delay)))
-      d.repeat_delay = j[GetSettingName(SwaySetting::repeat_delay)].get<int>();
+      d.repeat_delay = j[GetSettingName(SwaySetting::repeat_delay)].template get<int>();
     if (j.contains(GetSettingName(SwaySetting::repeat_rate)))
-      d.repeat_rate = j[GetSettingName(SwaySetting::repeat_rate)].get<int>();
+      d.repeat_rate = j[GetSettingName(SwaySetting::repeat_rate)].template get<int>();
   } else if (d.type == DevType::tablet_tool || d.type == DevType::tablet_pad) {
     SEnum tool({"pen", "eraser", "brush", "pencil", "airbrush", "*"});
     SEnum mode({"absolute", "relative"});
     /// FIXME: Somehow recieve this from swaymsg.
     tool.select("*");
-    mode.select("asolute");
+    mode.select("absolute");
     d.tool_mode = std::make_pair(tool, mode);
   }
 
-  const json& libinput = j.at("libinput");
+  const Json& libinput = j.at("libinput");
   d.send_events = stb(libinput[GetSettingName(SwaySetting::send_events)]);
 
   if (libinput.contains(GetSettingName(SwaySetting::tap_to_click)))
@@ -106,7 +162,7 @@ void from_json(const json& j, Opt<Device>& device) {
 
   if (libinput.contains(GetSettingName(SwaySetting::accel_speed)))
     d.accel_speed =
-        libinput[GetSettingName(SwaySetting::accel_speed)].get<float>();
+        libinput[GetSettingName(SwaySetting::accel_speed)].template get<float>();
   if (libinput.contains(GetSettingName(SwaySetting::accel_profile))) {
     d.accel_profiles = SEnum({"adaptive", "flat"});
     d.accel_profiles->select(
@@ -135,7 +191,7 @@ void from_json(const json& j, Opt<Device>& device) {
   }
   if (libinput.contains(GetSettingName(SwaySetting::scroll_button)))
     d.scroll_button =
-        libinput[GetSettingName(SwaySetting::scroll_button)].get<int>();
+        libinput[GetSettingName(SwaySetting::scroll_button)].template get<int>();
 
   if (libinput.contains(GetSettingName(SwaySetting::dwt)))
     d.dwt = stb(libinput[GetSettingName(SwaySetting::dwt)]);
@@ -146,185 +202,600 @@ void from_json(const json& j, Opt<Device>& device) {
     CalArr arr;
     int i = 0;
     for (auto& num : libinput[GetSettingName(SwaySetting::cal_mat)])
-      arr[i++] = num.get<float>();
+      arr[i++] = num.template get<float>();
     d.cal_mat = arr;
   }
 
-  device = d;
+  device = std::move(d);
 }
 
 // Get info about devices from swaymsg calls.
 void DeviceMan::parseSwaymsg() {
+  perf::ScopedTimer timer(perf::stats().discovery);
+  perf::AllocScope allocs(perf::Subsystem::discovery);
+
+  // Both requests are in flight at once.
+  auto inputs = submit(ipc::MsgType::get_inputs);
+  auto outputs = submit(ipc::MsgType::get_outputs);
+
+  // Json DOM of the previous discovery is released in one step and its
+  // memory is reused for this one.
+  m_arena->Reset();
+  arena::Scope scope(*m_arena);
+
   // Parse swaymsg inputs
-  json j_inputs;
-  get_inputs_json(j_inputs, m_swaymsg);
+  arena::json j_inputs = arena::json::parse(wait(inputs, ipc::MsgType::get_inputs));
+  m_Devices.reserve(j_inputs.size());
   for (auto& json_dev : j_inputs) {
     auto device = json_dev.get<Opt<Device>>();
     if (device)
-      m_Devices.push_back(device.value());
+      m_Devices.push_back(std::move(device.value()));
   }
 
-  // Parse swaymsg output names
-  json j_outputs;
-  get_outputs_json(j_outputs, m_swaymsg);
-  std::vector<std::string> outputs;
-  for (auto& out : j_outputs)
-    outputs.push_back(out.at("name"));
+  updateOutputs(wait(outputs, ipc::MsgType::get_outputs));
+  for (auto& device : m_Devices)
+    setDefaults(device);
+}
+
+template <typename Json> void from_json(const Json& j, Output& output) {
+  j.at("name").get_to(output.name);
+  output.active = j.value("active", true);
+  if (j.contains("rect")) {
+    const Json& rect = j["rect"];
+    output.x = rect.value("x", 0);
+    output.y = rect.value("y", 0);
+    output.width = rect.value("width", 0);
+    output.height = rect.value("height", 0);
+  }
+  output.scale = j.value("scale", 1.0f);
+  output.transform = j.value("transform", "normal");
+}
+
+template void from_json(const json& j, Opt<Device>& device);
+template void from_json(const arena::json& j, Opt<Device>& device);
+template void from_json(const json& j, Output& output);
+template void from_json(const arena::json& j, Output& output);
+
+void DeviceMan::updateOutputs(const std::string& reply) {
+  // Allocated from the arena, callers hold an arena::Scope.
+  arena::json j_outputs = arena::json::parse(reply);
+  m_Outputs = j_outputs.get<std::vector<Output>>();
+
+  std::vector<std::string> names;
+  for (auto& out : m_Outputs)
+    names.push_back(out.name);
+  m_outputs = SEnum(names);
+  m_outputs.options.push_back("*"); // Wildcard matching whole desktop layout.
+  m_outputs.select("*");
+
+  // Keep selected output of devices if it is still connected.
+  for (auto* devices : {&m_Devices, &m_backupDevices}) {
+    for (auto& dev : *devices) {
+      if (!dev.map_to_output)
+        continue;
+      SEnum outputs = m_outputs;
+      if (dev.map_to_output->sel >= 0 && dev.map_to_output->sel < dev.map_to_output->size())
+        outputs.select(dev.map_to_output.value()[dev.map_to_output->sel]);
+      dev.map_to_output = outputs;
+    }
+  }
+}
 
+void DeviceMan::setDefaults(Device& device) {
   // Save output names to map_to_output SEnum for devices that support it.
   // FIXME: For now we always set the same values initially, beacuse they cannot
   // be retrieved from swaymsg calls.
   //        We could workaround this by creating our own configs and loading
   //        them at start.
-  SEnum e(outputs);
-  e.options.push_back("*"); // Wildcard matching whole desktop layout.
-  e.select("*");
-  for (auto& device : m_Devices) {
-    switch (device.type) {
-    case DevType::pointer:
-    case DevType::touchpad:
-    case DevType::tablet_pad:
-    case DevType::tablet_tool:
-      device.map_to_output = e;
-      device.map_to_region = std::array<int, 4>{0, 0, 0, 0};
-      break;
-    case DevType::keyboard:
-      device.xkb_capslock = false;
-      device.xkb_numlock = false;
-      break;
-    default:
-      break;
+  switch (device.type) {
+  case DevType::pointer:
+  case DevType::touchpad:
+  case DevType::tablet_pad:
+  case DevType::tablet_tool:
+    device.map_to_output = m_outputs;
+    device.map_to_region = std::array<int, 4>{0, 0, 0, 0};
+    break;
+  case DevType::keyboard:
+    device.xkb_capslock = false;
+    device.xkb_numlock = false;
+    device.xkb_layout = std::string();
+    device.xkb_variant = std::string();
+    device.xkb_options = std::string();
+    break;
+  default:
+    break;
+  }
+}
+
+// Parse boolean like sway does.
+static bool parse_bool(const std::string& s) {
+  return s == "1" || s == "yes" || s == "on" || s == "true" || s == "enable" ||
+         s == "enabled" || s == "active";
+}
+
+// Set and enable option if the device has it.
+template <typename T, bool E> static void import_opt(Opt<T, E>& opt, const T& value) {
+  if (!opt)
+    return;
+  opt = value;
+  opt.m_Enabled = true;
+}
+
+// Set config only setting of the device from `input` block of sway config.
+// Settings which are read from sway are ignored.
+static void import_setting(Device& dev, const std::vector<std::string>& s) {
+  const std::string& name = s[0];
+  size_t args = s.size() - 1;
+  if (name == "xkb_capslock" && args >= 1)
+    import_opt(dev.xkb_capslock, parse_bool(s[1]));
+  else if (name == "xkb_numlock" && args >= 1)
+    import_opt(dev.xkb_numlock, parse_bool(s[1]));
+  else if (name == "xkb_layout" && args >= 1)
+    import_opt(dev.xkb_layout, s[1]);
+  else if (name == "xkb_variant" && args >= 1)
+    import_opt(dev.xkb_variant, s[1]);
+  else if (name == "xkb_options" && args >= 1)
+    import_opt(dev.xkb_options, s[1]);
+  else if (name == "map_to_output" && args >= 1 && dev.map_to_output) {
+    SEnum outputs = dev.map_to_output.value();
+    // Output may not be connected now.
+    if (std::find(outputs.begin(), outputs.end(), s[1]) == outputs.end())
+      outputs.options.push_back(s[1]);
+    outputs.select(s[1]);
+    import_opt(dev.map_to_output, outputs);
+  } else if (name == "map_to_region" && args >= 4) {
+    std::array<int, 4> region;
+    for (int i = 0; i < 4; i++)
+      region[i] = std::stoi(s[i + 1]);
+    import_opt(dev.map_to_region, region);
+  } else if (name == "tool_mode" && args >= 2 && dev.tool_mode) {
+    auto mode = dev.tool_mode.value();
+    if (mode.first.select(s[1]) && mode.second.select(s[2]))
+      import_opt(dev.tool_mode, mode);
+  }
+}
+
+// Set option to one of its choices, unknown choices are ignored.
+template <bool E> static void import_choice(Opt<SEnum, E>& opt, const std::string& value) {
+  if (!opt)
+    return;
+  SEnum choice = opt.value();
+  if (choice.select(value))
+    import_opt(opt, choice);
+}
+
+// Set any setting of the device from line of preset.
+static void preset_setting(Device& dev, const std::vector<std::string>& s) {
+  auto setting = GetSetting(s[0], false);
+  if (!setting || s.size() < 2) {
+    import_setting(dev, s);
+    return;
+  }
+  const std::string& value = s[1];
+  switch (setting.value()) {
+  case SwaySetting::scroll_factor: import_opt(dev.scroll_factor, std::stof(value)); break;
+  case SwaySetting::repeat_delay: import_opt(dev.repeat_delay, std::stoi(value)); break;
+  case SwaySetting::repeat_rate: import_opt(dev.repeat_rate, std::stoi(value)); break;
+  case SwaySetting::send_events: dev.send_events = value == "enabled"; break;
+  case SwaySetting::tap_to_click: import_opt(dev.tap_to_click, parse_bool(value)); break;
+  case SwaySetting::tap_and_drag: import_opt(dev.tap_and_drag, parse_bool(value)); break;
+  case SwaySetting::tap_drag_lock: import_opt(dev.tap_drag_lock, parse_bool(value)); break;
+  case SwaySetting::tap_button_map: import_choice(dev.tap_button_map, value); break;
+  case SwaySetting::left_handed: import_opt(dev.left_handed, parse_bool(value)); break;
+  case SwaySetting::natural_scroll: import_opt(dev.nat_scroll, parse_bool(value)); break;
+  case SwaySetting::middle_emulation: import_opt(dev.mid_emu, parse_bool(value)); break;
+  case SwaySetting::scroll_method: import_choice(dev.scroll_methods, value); break;
+  case SwaySetting::scroll_button: import_opt(dev.scroll_button, std::stoi(value)); break;
+  case SwaySetting::dwt: import_opt(dev.dwt, parse_bool(value)); break;
+  case SwaySetting::dwtp: import_opt(dev.dwtp, parse_bool(value)); break;
+  case SwaySetting::click_method: import_choice(dev.click_methods, value); break;
+  case SwaySetting::accel_profile: import_choice(dev.accel_profiles, value); break;
+  case SwaySetting::accel_speed: import_opt(dev.accel_speed, std::stof(value)); break;
+  case SwaySetting::cal_mat:
+    if (s.size() >= 7) {
+      CalArr mat;
+      for (int i = 0; i < 6; i++)
+        mat[i] = std::stof(s[i + 1]);
+      import_opt(dev.cal_mat, mat);
     }
+    break;
+  default: // Config only settings
+    import_setting(dev, s);
+    break;
   }
 }
 
-// This function convert a value to string that works in sway config file or
-// swaymsg calls.
-template <typename T> std::string to_string(const T& val) {
-  return std::to_string(val);
+size_t DeviceMan::ImportSwayConfig(std::string path) {
+  if (path.empty()) {
+    probeVersion();
+    path = m_loadedConfig;
+  }
+  if (path.empty())
+    path = swaycfg::default_path();
+  if (path.empty())
+    return 0;
+
+  m_configBlocks = swaycfg::parse(path);
+  m_configIndex.clear();
+  for (size_t i = 0; i < m_configBlocks.size(); i++)
+    m_configIndex[m_configBlocks[i].identifier].push_back(i);
+  for (auto& dev : m_Devices)
+    importConfig(dev);
+  for (auto& dev : m_backupDevices)
+    importConfig(dev);
+  return m_configBlocks.size();
 }
 
-template <> std::string to_string(const SEnum& e) { return (std::string)e; }
-template <> std::string to_string(const bool& b) { return bts(b); }
-template <>
-std::string to_string(const CalArr& arr) // Calibration array
-{
-  std::string out = "";
-  for (int i = 0; i < (int)arr.size(); i++)
-    out += std::to_string(arr[i]) + (i + 1 == (int)arr.size() ? "" : " ");
-  return out;
-}
-template <> std::string to_string(const std::pair<SEnum, SEnum>& pair_e) {
-  return (std::string)pair_e.first + (std::string)pair_e.second;
-}
-template <>
-std::string
-to_string(const std::array<int, 4>& region) // Map to region value (maybe should
-                                            // be merged with CalArr above..)
-{
-  std::string out = "";
-  for (int i = 0; i < 4; i++)
-    out += std::to_string(region[i]) + (i == 3 ? "" : " ");
-  return out;
+void DeviceMan::importConfig(Device& device) {
+  // Identifier blocks override type blocks which override wildcard.
+  const std::string ids[] = {"*", "type:" + GetTypeName(device.type), device.sway_id};
+  for (const std::string& id : ids) {
+    auto it = m_configIndex.find(id);
+    if (it == m_configIndex.end())
+      continue;
+    for (size_t i : it->second) {
+      const swaycfg::InputBlock& block = m_configBlocks[i];
+      for (auto& setting : block.settings) {
+        try {
+          import_setting(device, setting);
+        } catch (const std::exception& e) {
+          std::cerr << "Invalid " << setting[0] << " of input " << block.identifier
+                    << " in sway config: " << e.what() << std::endl;
+        }
+      }
+    }
+  }
 }
 
-// Return the input parameter in format '<setting name> <setting values...>' for
-// use in swaymsg call
-inline std::string get_input_param(SwaySetting setting,
-                                   const std::string& value) {
-  return GetSettingName(setting, false) + " " + value;
+size_t DeviceMan::LoadPresets(const std::string& path) {
+  m_presetPath = path;
+  if (access(path.c_str(), F_OK) != 0) {
+    m_presets = std::make_unique<PresetLibrary>();
+    return 0;
+  }
+  m_presets = std::make_unique<PresetLibrary>(path);
+
+  size_t matched = 0;
+  for (auto& dev : m_Devices)
+    matched += applyPreset(dev);
+  return matched;
 }
 
-// Call `swaymsg input` command.
-void sway_write(const std::string& swaymsg, const std::string& sway_id,
-                SwaySetting setting, const std::string& value) {
-  std::string cmd = swaymsg + " input '" + sway_id + "' '" +
-                    get_input_param(setting, value) + "'";
-  std::system(cmd.c_str());
+bool DeviceMan::applyPreset(Device& device) {
+  if (m_presets->Empty())
+    return false;
+  // Same precedence as config blocks.
+  constexpr DevType any = PresetLibrary::ANY_TYPE;
+  const std::pair<std::string_view, DevType> keys[] = {
+      {"*", any}, {"*", device.type}, {device.sway_id, any}, {device.sway_id, device.type}};
+  bool found = false;
+  std::vector<std::string> setting;
+  for (auto& [sway_id, type] : keys) {
+    auto settings = m_presets->Find(sway_id, type);
+    if (!settings)
+      continue;
+    found = true;
+    for (auto& token : swaycfg::tokenize(*settings)) {
+      if (token.kind == swaycfg::Token::word) {
+        setting.push_back(token.text);
+        continue;
+      }
+      if (setting.empty())
+        continue;
+      try {
+        preset_setting(device, setting);
+      } catch (const std::exception& e) {
+        std::cerr << "Invalid " << setting[0] << " of preset " << sway_id << " in "
+                  << m_presetPath << ": " << e.what() << std::endl;
+      }
+      setting.clear();
+    }
+  }
+  return found;
+}
+
+void DeviceMan::SavePreset(int device_index, bool match_type) {
+  Device& dev = m_Devices[device_index];
+  std::vector<PresetLibrary::Entry> entries = m_presets->Entries();
+  entries.push_back({match_type ? "*" : dev.sway_id, dev.type, ""});
+  AppendSettings(device_index, entries.back().settings);
+
+  if (m_presetPath.empty())
+    m_presetPath = PresetLibrary::DefaultPath();
+  PresetLibrary::Write(m_presetPath, entries);
+  m_presets = std::make_unique<PresetLibrary>(m_presetPath);
+}
+
+void DeviceMan::StartEvents(std::function<void()> on_event) {
+  m_onEvent = std::move(on_event);
+  m_events = std::make_unique<ipc::EventPump>(*m_transport, R"(["input", "output"])", m_onEvent);
+}
+
+void DeviceMan::Refresh() {
+  m_Devices.clear();
+  parseSwaymsg();
+  for (auto& dev : m_Devices)
+    importConfig(dev);
+  m_backupDevices = m_Devices;
+  for (auto& dev : m_Devices)
+    applyPreset(dev);
+  m_generation++;
+}
+
+void DeviceMan::SetTransport(std::unique_ptr<ipc::Transport> transport) {
+  bool events = m_events != nullptr;
+  m_events.reset();
+  m_transport = std::move(transport);
+  if (events)
+    StartEvents(m_onEvent);
+}
+
+bool DeviceMan::ProcessEvents() {
+  if (!m_events)
+    return false;
+
+  auto events = m_events->Poll();
+  if (events.empty())
+    return false;
+
+  // Hot-plug events keep coming for the life of the process. Their json is
+  // parsed into the arena, so it doesn't fragment the heap.
+  perf::AllocScope allocs(perf::Subsystem::events);
+  m_arena->Reset();
+  arena::Scope scope(*m_arena);
+  bool changed = false;
+  bool outputs_changed = false;
+  for (auto& msg : events) {
+    // Output events carry no details, outputs are read again once below.
+    if (msg.type == uint32_t(ipc::EventType::output))
+      outputs_changed = true;
+    if (msg.type != uint32_t(ipc::EventType::input))
+      continue;
+
+    // Malformed event is dropped, the rest are still handled. Devices are
+    // added only after everything that can throw, so they stay paired with
+    // their backups.
+    try {
+      arena::json event = arena::json::parse(msg.payload);
+      std::string change = event.value("change", "");
+      const arena::json& input = event.at("input");
+      if (change == "added") {
+        auto device = input.get<Opt<Device>>();
+        if (!device)
+          continue;
+        setDefaults(device.value());
+        importConfig(device.value());
+        Device backup = device.value();
+        applyPreset(device.value());
+        m_backupDevices.push_back(std::move(backup));
+        m_Devices.push_back(std::move(device.value()));
+        changed = true;
+      } else if (change == "removed") {
+        std::string id = input.at("identifier");
+        for (size_t i = 0; i < m_Devices.size(); i++) {
+          if (m_Devices[i].sway_id != id)
+            continue;
+          m_Devices.erase(m_Devices.begin() + i);
+          m_backupDevices.erase(m_backupDevices.begin() + i);
+          changed = true;
+          break;
+        }
+      }
+    } catch (const std::exception& e) {
+      std::cerr << "Dropping input event: " << e.what() << std::endl;
+    }
+  }
+  if (changed)
+    m_generation++;
+  if (outputs_changed) {
+    // Outputs are read again on the next output event.
+    try {
+      updateOutputs(request(ipc::MsgType::get_outputs));
+    } catch (const std::exception& e) {
+      std::cerr << "Failed to refresh outputs: " << e.what() << std::endl;
+    }
+  }
+  return changed || outputs_changed;
+}
+
+// Command batch being built for one device.
+struct CommandBatch {
+  std::string& out;
+  std::vector<SwaySetting>& settings; // Setting of every appended command
+  uint32_t skip;                      // Settings sway rejected before
+  size_t done;                        // Leading commands which already ran
+};
+
+// Append command setting the parameter to command batch unless it is known
+// to be rejected.
+template <typename T>
+void batch_write(CommandBatch& batch, const std::string& sway_id, SwaySetting setting,
+                 const T& value) {
+  if (batch.skip & CapabilityCache::bit(setting))
+    return;
+  if (batch.done > 0) {
+    batch.done--;
+    return;
+  }
+  swayfmt::command(batch.out, sway_id, setting, value);
+  batch.settings.push_back(setting);
 }
 
 // Wrapper write function checking if option should be written or not.
 template <typename T, bool B>
-void opt_write(std::string swaymsg, std::string sway_id, SwaySetting setting,
+void opt_write(CommandBatch& batch, const std::string& sway_id, SwaySetting setting,
                Opt<T, B>& value) {
   if (value && value.m_Enabled)
-    sway_write(swaymsg, sway_id, setting, to_string(value.value()));
+    batch_write(batch, sway_id, setting, value.value());
 }
 
-// Write parameter as a part of config into 'out' string.
+// Append parameter as a part of config to 'out' string.
 template <typename T, bool B>
 void opt_conf(std::string& out, SwaySetting setting, Opt<T, B>& opt) {
   if (opt && opt.m_Enabled)
-    out += "    " + get_input_param(setting, to_string(opt.value())) + "\n";
+    swayfmt::config_line(out, setting, opt.value());
 }
 
 // Call opt_write or opt_conf depending on the is_write parameter with given
 // arguments.
-template <bool is_write, typename... Args, typename Str>
-inline void opt_call(const std::string& swaymsg, const std::string& sway_id,
-                     Str&& out, Args&&... args) {
+template <bool is_write, typename Out, typename... Args>
+inline void opt_call(const std::string& sway_id, Out& out, Args&&... args) {
   if constexpr (is_write)
-    opt_write(swaymsg, sway_id, std::forward<Args>(args)...);
+    opt_write(out, sway_id, std::forward<Args>(args)...);
   else
-    opt_conf(std::forward<Str>(out), std::forward<Args>(args)...);
-}
-
-// Write changes or generate config parameters into 'out' depending on the
-// 'is_write' template parameter. NOTE: Why? Because I want to avoid having to
-// type all those calls below multiple times for config generation and writes.
-// NOTE: `out` is templated so that we can pass both lvalues and rvalues (when
-// we dont use it) as parameter.
-template <bool is_write, typename Str>
-void opt_calls(const std::string& swaymsg, Device& dev, Str&& out) {
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::scroll_factor, dev.scroll_factor);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::repeat_delay, dev.repeat_delay);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::repeat_rate, dev.repeat_rate);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::tool_mode, dev.tool_mode);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::map_to_output, dev.map_to_output);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::map_to_region, dev.map_to_region);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::tap_to_click, dev.tap_to_click);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::tap_and_drag, dev.tap_and_drag);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::tap_drag_lock, dev.tap_drag_lock);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::tap_button_map, dev.tap_button_map);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::left_handed, dev.left_handed);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::natural_scroll, dev.nat_scroll);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::middle_emulation, dev.mid_emu);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::cal_mat, dev.cal_mat);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::scroll_method, dev.scroll_methods);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::scroll_button, dev.scroll_button);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::dwt, dev.dwt);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::dwtp, dev.dwtp);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::click_method, dev.click_methods);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::accel_profile, dev.accel_profiles);
-  opt_call<is_write>(swaymsg, dev.sway_id, out, SwaySetting::accel_speed, dev.accel_speed);
+    opt_conf(out, std::forward<Args>(args)...);
+}
+
+// Append command batch or generate config parameters into 'out' depending on
+// the 'is_write' template parameter. NOTE: Why? Because I want to avoid having
+// to type all those calls below multiple times for config generation and writes.
+template <bool is_write, typename Out>
+void opt_calls(Device& dev, Out& out) {
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::scroll_factor, dev.scroll_factor);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::repeat_delay, dev.repeat_delay);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::repeat_rate, dev.repeat_rate);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::tool_mode, dev.tool_mode);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::map_to_output, dev.map_to_output);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::map_to_region, dev.map_to_region);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::tap_to_click, dev.tap_to_click);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::tap_and_drag, dev.tap_and_drag);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::tap_drag_lock, dev.tap_drag_lock);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::tap_button_map, dev.tap_button_map);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::left_handed, dev.left_handed);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::natural_scroll, dev.nat_scroll);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::middle_emulation, dev.mid_emu);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::cal_mat, dev.cal_mat);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::scroll_method, dev.scroll_methods);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::scroll_button, dev.scroll_button);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::dwt, dev.dwt);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::dwtp, dev.dwtp);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::click_method, dev.click_methods);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::accel_profile, dev.accel_profiles);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::accel_speed, dev.accel_speed);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::xkb_layout, dev.xkb_layout);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::xkb_variant, dev.xkb_variant);
+  opt_call<is_write>(dev.sway_id, out, SwaySetting::xkb_options, dev.xkb_options);
+}
+
+// Error of a setting the device or sway version doesn't have, as opposed to
+// a value sway refused (e.g. unknown xkb layout).
+static bool unsupported_error(std::string_view error) {
+  return error.starts_with("Unknown/invalid command") ||
+         error.starts_with("Invalid input subcommand") ||
+         error.find("not supported") != std::string_view::npos;
 }
 
 void DeviceMan::ApplyChanges(int device_index, bool backup) {
+  ApplyChanges(std::span(&device_index, 1), backup);
+}
+
+void DeviceMan::ApplyChanges(std::span<const int> devices, bool backup) {
+  perf::ScopedTimer timer(backup ? perf::stats().revert : perf::stats().apply);
+  perf::AllocScope allocs(perf::Subsystem::apply);
+
+  // All settings of a device are sent as one command batch. The buffer is
+  // reused, so it doesn't allocate once it has grown.
+  m_batchSettings.clear();
+  m_pending.clear();
+  m_applyErrors.clear();
+  for (int device_index : devices)
+    submitBatch(device_index, backup, 0);
+
+  // Sway stops a batch at the first failed command, so the reply has one
+  // result per command up to the failed one. Settings the device doesn't
+  // support are not sent again, refused values only fail this time. The
+  // rest of the batch is sent once more after the failed command. Every
+  // round gets past a command of each retried device, so this ends.
+  while (!m_pending.empty()) {
+    m_retry.clear();
+    for (size_t p = 0; p < m_pending.size(); p++) {
+      json reply = json::parse(wait(m_pending[p].ticket, ipc::MsgType::run_command));
+      Device& dev = backup ? m_backupDevices[m_pending[p].device] : m_Devices[m_pending[p].device];
+      size_t end = p + 1 < m_pending.size() ? m_pending[p + 1].settings : m_batchSettings.size();
+      bool rejected = false;
+      for (size_t i = 0; i < reply.size(); i++) {
+        if (reply[i].value("success", false))
+          continue;
+        std::string error = reply[i].value("error", "");
+        std::cerr << "Failed to apply setting of " << dev.sway_id << ": " << error << std::endl;
+        if (m_pending[p].settings + i >= end)
+          continue;
+        SwaySetting setting = m_batchSettings[m_pending[p].settings + i];
+        rejected = unsupported_error(error);
+        if (rejected)
+          m_capabilities->Reject(dev.sway_id, setting);
+        else
+          m_applyErrors.push_back(dev.sway_id + ": " + GetSettingName(setting, false) + ": " + error);
+      }
+      // Rejected setting is skipped by the next batch, so it doesn't count.
+      if (!reply.empty() && !reply.back().value("success", false) &&
+          m_pending[p].settings + reply.size() < end)
+        m_retry.push_back({m_pending[p].device, 0, 0, m_pending[p].done + reply.size() - rejected});
+    }
+
+    m_batchSettings.clear();
+    m_pending.clear();
+    for (auto& retry : m_retry)
+      submitBatch(retry.device, backup, retry.done);
+  }
+  if (!m_capabilities->Save())
+    std::cerr << "Failed to save " << m_capabilities->Path() << std::endl;
+}
+
+void DeviceMan::AppendCommands(int device_index, std::string& out, bool backup) {
+  m_batchSettings.clear();
+  appendCommands(backup ? m_backupDevices[device_index] : m_Devices[device_index], out);
+}
+
+void DeviceMan::submitBatch(int device_index, bool backup, size_t done) {
   Device& dev = backup ? m_backupDevices[device_index] : m_Devices[device_index];
-  sway_write(m_swaymsg, dev.sway_id, SwaySetting::send_events, bts(dev.send_events));
-  opt_calls<true>(m_swaymsg, dev, "");
+  size_t settings = m_batchSettings.size();
+  m_batch.clear();
+  appendCommands(dev, m_batch, done);
+  if (!m_batch.empty())
+    m_pending.push_back({device_index, submit(ipc::MsgType::run_command, m_batch), settings, done});
+}
+
+void DeviceMan::appendCommands(Device& dev, std::string& out, size_t done) {
+  CommandBatch batch{out, m_batchSettings, m_capabilities->Rejected(dev.sway_id), done};
+  batch_write(batch, dev.sway_id, SwaySetting::send_events, dev.send_events);
+  opt_calls<true>(dev, batch);
 }
 
 std::string DeviceMan::GetSwayConfig(int device_index, bool match_type) {
-  Device& dev = m_Devices[device_index];
   std::string conf;
-  if (match_type)
-    conf = "input type:" + GetTypeName(dev.type) + " {\n";
-  else
-    conf = "input " + dev.sway_id + " {\n";
+  AppendSwayConfig(device_index, conf, match_type);
+  return conf;
+}
 
-  conf +=
-      "    " +
-      get_input_param(SwaySetting::send_events, to_string(dev.send_events)) +
-      "\n";
-  opt_calls<false>(m_swaymsg, dev, conf);
+void DeviceMan::AppendSwayConfig(int device_index, std::string& conf, bool match_type) {
+  Device& dev = m_Devices[device_index];
+  conf += "input ";
+  if (match_type) {
+    conf += "type:";
+    conf += DEV_CAP_S[(int)dev.type];
+  } else {
+    swayfmt::append(conf, dev.sway_id);
+  }
+  conf += " {\n";
+  AppendSettings(device_index, conf);
+  conf += "}";
+}
 
-  /* Config only options */
-  if (dev.xkb_capslock && dev.xkb_capslock.m_Enabled)
-    conf += "    xkb_capslock " + bts(dev.xkb_capslock.value()) + "\n";
-  if (dev.xkb_numlock && dev.xkb_numlock.m_Enabled)
-    conf += "    xkb_numlock " + bts(dev.xkb_numlock.value()) + "\n";
+void DeviceMan::AppendSettings(int device_index, std::string& conf) {
+  Device& dev = m_Devices[device_index];
+  swayfmt::config_line(conf, SwaySetting::send_events, dev.send_events);
+  opt_calls<false>(dev, conf);
 
-  conf += "}";
-  return conf;
+  /* Config only options */
+  if (dev.xkb_capslock && dev.xkb_capslock.m_Enabled) {
+    conf += "    xkb_capslock ";
+    swayfmt::append(conf, dev.xkb_capslock.value());
+    conf += '\n';
+  }
+  if (dev.xkb_numlock && dev.xkb_numlock.m_Enabled) {
+    conf += "    xkb_numlock ";
+    swayfmt::append(conf, dev.xkb_numlock.value());
+    conf += '\n';
+  }
 }
@@ -5,14 +5,26 @@
 #pragma once
 #include <algorithm>
 #include <array>
+#include <functional>
 #include <initializer_list>
 #include <iterator>
 #include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <utility> // std::pair
+#include <nlohmann/json_fwd.hpp>
+
+#include "sway_config.h"
+#include "sway_ipc.h"
+
+class CapabilityCache;
+class PresetLibrary;
+namespace arena { class Arena; }
+enum class SwaySetting : int;
 
 /// Datatype representing libinput calibration 2x3 matrix
 using CalArr = std::array<float, 6>;
@@ -52,6 +64,11 @@ public:
     m_val = t;
     return *this;
   }
+  Opt& operator=(T&& t) {
+    m_hasVal = true;
+    m_val = std::move(t);
+    return *this;
+  }
   operator bool() const { return m_hasVal; }
   T* operator->() { return &m_val; }
 
@@ -66,7 +83,7 @@ private:
 
 /// Get name of the enum from enum_strings.
 template <typename T>
-std::string
+const std::string&
 GetEnumName(const std::array<std::string, (int)T::size>& enum_strings,
             T enum_elem) {
   return enum_strings[(int)enum_elem];
@@ -100,7 +117,7 @@ const std::array<std::string, (int)DevType::size> DEV_CAP_S = {
     "keyboard",   "pointer", "touchpad", "tablet_tool",
     "tablet_pad", "gesture", "switch",   "unknown"};
 /// Get DevType string from enum.
-inline std::string GetTypeName(DevType c) { return GetEnumName(DEV_CAP_S, c); }
+inline const std::string& GetTypeName(DevType c) { return GetEnumName(DEV_CAP_S, c); }
 /// Get DevType enum from string.
 inline Opt<DevType> GetType(std::string name) { return GetEnumFromName<DevType>(DEV_CAP_S, name); }
 
@@ -185,6 +202,10 @@ struct Device {
   /* Keyboard - can be set in config only */
   Opt<bool, false> xkb_capslock; ///< Initially enable capslock
   Opt<bool, false> xkb_numlock;  ///< Initially enable numlock
+  /* Keyboard - cannot GET from swaymsg */
+  Opt<std::string, false> xkb_layout;  ///< Comma separated xkb layouts
+  Opt<std::string, false> xkb_variant; ///< Comma separated variants of the layouts
+  Opt<std::string, false> xkb_options; ///< Comma separated xkb options
 
   /* Tablet */
   Opt<std::pair<SEnum, SEnum>, false> tool_mode;
@@ -214,6 +235,29 @@ struct Device {
   Opt<float> accel_speed;
 };
 
+/// Output (monitor) devices can be mapped to.
+struct Output {
+  std::string name;
+  bool active = true;
+  int x = 0, y = 0;          ///< Position in the layout
+  int width = 0, height = 0; ///< Size in layout (logical) pixels
+  float scale = 1.0f;
+  std::string transform = "normal";
+};
+
+/**
+ * @brief Convert json block from `swaymsg -t get_outputs`.
+ * @tparam Json nlohmann::json or arena::json
+ */
+template <typename Json> void from_json(const Json& j, Output& output);
+
+/**
+ * @brief Convert json block from `swaymsg -t get_inputs` to Device.
+ * @tparam Json nlohmann::json or arena::json
+ * @param device Empty if the device type is in DeviceMan::SKIP_CAP.
+ */
+template <typename Json> void from_json(const Json& j, Opt<Device>& device);
+
 /**
  * @brief Manages getting all devices and their parameters.
  */
@@ -225,7 +269,15 @@ public:
       DevType::sw, // Switch devices such as Lid-switch
       DevType::gesture};
   std::vector<Device> m_Devices;
+  /// All outputs, kept current by output events (see StartEvents()).
+  std::vector<Output> m_Outputs;
 
+  /**
+   * @brief Discover devices using given connection to sway.
+   * @param transport Transport over which all requests are sent.
+   */
+  DeviceMan(std::unique_ptr<ipc::Transport> transport);
+  /// Discover devices by calling swaymsg executable.
   DeviceMan(std::string swaymsg_path);
   ~DeviceMan();
 
@@ -233,8 +285,26 @@ public:
    * @brief Apply all changes to device settings.
    * @param device Index of the device in m_Devices arr.
    * @param backup Use stored initial backup of device configuration.
+   * @exception ipc::TimeoutError When sway doesn't reply in time.
    */
   void ApplyChanges(int device, bool backup = false);
+  /**
+   * @brief Apply all changes to settings of several devices.
+   *
+   * Command batches of all devices are sent before waiting for any reply,
+   * so over the sway socket this takes about a single round trip.
+   * @param devices Indices of the devices in m_Devices arr.
+   * @param backup Use stored initial backup of device configuration.
+   * @exception ipc::TimeoutError When sway doesn't reply in time.
+   */
+  void ApplyChanges(std::span<const int> devices, bool backup = false);
+  /**
+   * @brief Settings sway refused with their value in the last ApplyChanges().
+   *
+   * Unlike settings the device doesn't support (see Capabilities()), they
+   * are sent again by the next apply. One `<id>: <setting>: <error>` each.
+   */
+  inline const std::vector<std::string>& ApplyErrors() const { return m_applyErrors; }
 
   /**
    * Revert changes to device to initial state (whel calling Init()).
@@ -258,6 +328,97 @@ public:
    * @param device Index of the device in m_Devices array
    */
   std::string GetSwayConfig(int device, bool match_type = false);
+  /// Same as GetSwayConfig(), but appends to `out`.
+  void AppendSwayConfig(int device, std::string& out, bool match_type = false);
+  /// Append settings of the device as lines of `input` block body.
+  void AppendSettings(int device, std::string& out);
+  /**
+   * @brief Append `input` commands applying all settings of the device.
+   *
+   * Settings sway rejected for the device before are skipped.
+   * @param backup Use stored initial backup of device configuration.
+   */
+  void AppendCommands(int device, std::string& out, bool backup = false);
+
+  /**
+   * @brief Seed settings which can't be read from sway from its config.
+   *
+   * Values from matching `input` blocks are set and enabled in current and
+   * backup devices. Blocks are applied in the same order of precedence as
+   * sway does (`*`, `type:`, identifier) and are kept for devices plugged
+   * in later.
+   * @param path Sway config to read. Config loaded by sway when empty.
+   * @return Number of `input` blocks found.
+   */
+  size_t ImportSwayConfig(std::string path = "");
+
+  /**
+   * @brief Seed settings of devices from preset library.
+   *
+   * Only presets of connected devices are looked up, the rest of the library
+   * is never read. Presets are applied in the same order of precedence as
+   * sway config blocks (`*`, type, identifier) and are kept for devices
+   * plugged in later. Only m_Devices change, the settings are sent to sway
+   * by ApplyChanges().
+   * @param path Library file. Missing file is an empty library.
+   * @return Number of devices with a preset.
+   * @exception std::runtime_error When the file isn't a preset library.
+   */
+  size_t LoadPresets(const std::string& path);
+  /**
+   * @brief Store current settings of the device in the preset library.
+   * @param match_type Store as preset of all devices of the type.
+   * @exception std::runtime_error When the library can't be written.
+   */
+  void SavePreset(int device, bool match_type = false);
+  /// Presets loaded by LoadPresets().
+  inline const PresetLibrary& Presets() const { return *m_presets; }
+
+  /**
+   * @brief Persist settings sway rejected, so they are skipped in later runs.
+   *
+   * Settings rejected by sway are never sent to the same device again. This
+   * probes sway version and loads rejections learned from the same version.
+   * @param path Cache file (see CapabilityCache::DefaultPath()).
+   */
+  void LoadCapabilities(const std::string& path);
+  /// Settings sway reported as unsupported by each device.
+  inline CapabilityCache& Capabilities() { return *m_capabilities; }
+  /// `human_readable` version of running sway, empty if unknown.
+  const std::string& SwayVersion();
+
+  /**
+   * @brief Start receiving input and output events (hot-plug) on background thread.
+   * @param on_event Called from the background thread when event arrives.
+   */
+  void StartEvents(std::function<void()> on_event);
+  /**
+   * @brief Process events received since last call.
+   *
+   * Added devices are appended to m_Devices and removed devices are erased,
+   * so indices of devices after the removed one change. Output changes
+   * refresh m_Outputs and output names of all devices.
+   * @return TRUE if m_Devices or m_Outputs changed.
+   */
+  bool ProcessEvents();
+  /**
+   * @brief Send all further requests over another connection to sway.
+   *
+   * Devices are kept. Events are received from the new connection if they
+   * were started.
+   */
+  void SetTransport(std::unique_ptr<ipc::Transport> transport);
+  /// Set time after which requests to sway fail (see ipc::Transport::SetTimeout()).
+  inline void SetTimeout(std::chrono::milliseconds timeout) { m_transport->SetTimeout(timeout); }
+  /**
+   * @brief Discover all devices again.
+   *
+   * Devices are replaced by the current state reported by sway (unapplied
+   * edits are dropped) with imported config and presets, like on start.
+   */
+  void Refresh();
+  /// Incremented whenever devices are added or removed.
+  inline uint64_t Generation() const { return m_generation; }
 
   Device& operator[](const size_t& i) { return m_Devices.at(i); }
   Device& Get(const size_t& i_device) { return (*this)[i_device]; }
@@ -267,12 +428,74 @@ public:
 private:
   // Holds initial configuration of devices.
   std::vector<Device> m_backupDevices;
-  // Holds name of the swaymsg executable to call
-  // when applying changes.
-  std::string m_swaymsg;
+  // Connection to sway used for all requests.
+  std::unique_ptr<ipc::Transport> m_transport;
+  // Receives events from m_transport. Must be destroyed before it.
+  std::unique_ptr<ipc::EventPump> m_events;
+  std::function<void()> m_onEvent;
+  // Json DOM of replies parsed by the last discovery or event batch.
+  std::unique_ptr<arena::Arena> m_arena;
+  // Names of the outputs devices can be mapped to.
+  SEnum m_outputs;
+  uint64_t m_generation = 0;
+  // Command batch buffer reused by ApplyChanges().
+  std::string m_batch;
+  // Setting of every command in sent batches, to match them with the reply.
+  std::vector<SwaySetting> m_batchSettings;
+  // Command batch waiting for reply.
+  struct PendingBatch {
+    int device;
+    ipc::Transport::Ticket ticket;
+    size_t settings; // First setting of the batch in m_batchSettings
+    size_t done;     // Commands of the device run by earlier batches
+  };
+  std::vector<PendingBatch> m_pending;
+  // Batches cut short by a failed command, rest is sent again.
+  std::vector<PendingBatch> m_retry;
+  // Settings refused by sway with their value in the last ApplyChanges().
+  std::vector<std::string> m_applyErrors;
+  std::unique_ptr<CapabilityCache> m_capabilities;
+  std::unique_ptr<PresetLibrary> m_presets;
+  std::string m_presetPath;
+  // Reply to GET_VERSION, requested at most once.
+  bool m_versionProbed = false;
+  std::string m_swayVersion;
+  std::string m_loadedConfig;
+  // Input blocks of sway config imported by ImportSwayConfig().
+  std::vector<swaycfg::InputBlock> m_configBlocks;
+  // Indices of m_configBlocks by identifier, in order of appearance.
+  std::unordered_map<std::string, std::vector<size_t>> m_configIndex;
 
   /// Parse information about libinput devices via swaymsg.
   void parseSwaymsg();
+  /// Set initial values of settings which cannot be retrieved from swaymsg.
+  void setDefaults(Device& device);
+  /**
+   * @brief Update outputs and map_to_output of all devices, keeping selection.
+   * @param reply Reply to GET_OUTPUTS.
+   */
+  void updateOutputs(const std::string& reply);
+  /**
+   * @brief Append commands of the device to `out` and their settings to m_batchSettings.
+   * @param done Number of leading commands to leave out, they already ran.
+   */
+  void appendCommands(Device& device, std::string& out, size_t done = 0);
+  /// Submit command batch of the device without its first `done` commands.
+  void submitBatch(int device, bool backup, size_t done);
+  /// Set values from imported sway config blocks matching the device.
+  void importConfig(Device& device);
+  /// Set values from presets matching the device. Returns TRUE if any matched.
+  bool applyPreset(Device& device);
+  /// Request sway version and config path it loaded if not done yet.
+  void probeVersion();
+  /// Send request to sway and update performance counters.
+  std::string request(ipc::MsgType type, const std::string& payload = "");
+  /// Send request without waiting for reply and update performance counters.
+  ipc::Transport::Ticket submit(ipc::MsgType type, const std::string& payload = "");
+  /// Wait for reply of submit() of given type and update performance counters.
+  std::string wait(ipc::Transport::Ticket ticket, ipc::MsgType type);
+  /// Record time blocked on a reply since `start` and report slow requests.
+  void recordLatency(ipc::MsgType type, uint64_t start);
 };
 
 /// Define settings a device can have. Taken from `man sway-input`
@@ -299,6 +522,9 @@ enum class SwaySetting : int {
   click_method,
   accel_profile,
   accel_speed,
+  xkb_layout,
+  xkb_variant,
+  xkb_options,
   size
 };
 
@@ -330,7 +556,10 @@ const static std::array<std::string, (int)SwaySetting::size> SWAY_SETTING_GET =
      "dwtp",
      "click_method",
      "accel_profile",
-     "accel_speed"};
+     "accel_speed",
+     "xkb_layout",
+     "xkb_variant",
+     "xkb_options"};
 
 /// Define names of the settings when using `swaymsg input <set setting> ...` or
 /// generating sway config. NOTE: Does not contain config only options.
@@ -356,10 +585,13 @@ const static std::array<std::string, (int)SwaySetting::size> SWAY_SETTING_SET{
     SWAY_SETTING_GET[18],
     SWAY_SETTING_GET[19],
     SWAY_SETTING_GET[20],
-    "pointer_accel"};
+    "pointer_accel",
+    SWAY_SETTING_GET[22],
+    SWAY_SETTING_GET[23],
+    SWAY_SETTING_GET[24]};
 
-inline std::string GetSettingName(SwaySetting s, bool get = true) {
-  return GetEnumName(get ? SWAY_SETTING_GET : SWAY_SETTING_SET, s);
+inline const std::string& GetSettingName(SwaySetting s, bool get = true) {
+  return (get ? SWAY_SETTING_GET : SWAY_SETTING_SET)[(int)s];
 }
 inline Opt<SwaySetting> GetSetting(std::string name, bool get = true) {
   return GetEnumFromName<SwaySetting>(get ? SWAY_SETTING_GET : SWAY_SETTING_SET,
@@ -0,0 +1,58 @@
+/**
+ * @brief Implementation of EventLoop
+ * @file event_loop.cpp
+ */
+#include "event_loop.h"
+#include <imguiwrapper.hpp>
+#include <imgui_internal.h>
+
+void EventLoop::Wake() {
+  m_woken.store(true, std::memory_order_release);
+  glfwPostEmptyEvent();
+}
+
+void EventLoop::WakeAfter(float seconds) {
+  auto deadline = clock::now() + std::chrono::duration_cast<clock::duration>(
+                                   std::chrono::duration<float>(seconds));
+  if (deadline < m_deadline)
+    m_deadline = deadline;
+}
+
+void EventLoop::KeepActive() {
+  m_activeUntil = clock::now() + std::chrono::duration_cast<clock::duration>(
+                                   std::chrono::duration<float>(ACTIVE_TIME));
+}
+
+float EventLoop::Wait() {
+  auto now = clock::now();
+  if (m_woken.exchange(false, std::memory_order_acquire))
+    KeepActive();
+  if (!m_Enabled || now < m_activeUntil)
+    return 0.0f;
+  if (m_pendingFrames > 0) {
+    m_pendingFrames--;
+    return 0.0f;
+  }
+
+  // Keep ImGui text cursor blinking while editing text.
+  if (ImGui::GetIO().WantTextInput)
+    WakeAfter(ACTIVE_TIME);
+
+  if (m_deadline == clock::time_point::max())
+    glfwWaitEvents();
+  else if (m_deadline > now)
+    glfwWaitEventsTimeout(std::chrono::duration<double>(m_deadline - now).count());
+  m_deadline = clock::time_point::max();
+
+  // Input and Wake() need a while to be fully processed by ImGui (hover
+  // delays, popups opening...). Deadline without any input only needs one
+  // more frame, so that the freshly computed state is shown right away
+  // instead of after the next wait.
+  if (m_woken.exchange(false, std::memory_order_acquire) ||
+      ImGui::GetCurrentContext()->InputEventsQueue.Size > 0)
+    KeepActive();
+  else
+    m_pendingFrames = 1;
+
+  return std::chrono::duration<float>(clock::now() - now).count();
+}
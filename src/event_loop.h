@@ -0,0 +1,42 @@
+/**
+ * @brief Decides when the next frame should be rendered.
+ * @file event_loop.h
+ *
+ * ImWrap renders frames continuously. EventLoop::Wait() is called at the end
+ * of every frame and blocks until there is a reason to render again: user
+ * input, Wake() from another thread (IPC event, finished background work) or
+ * a deadline requested by WakeAfter() (e.g. a countdown tick).
+ */
+#pragma once
+#include <atomic>
+#include <chrono>
+
+class EventLoop {
+public:
+  /// Time to keep rendering at full rate after the last wake up. This gives
+  /// ImGui time to process input, show delayed tooltips etc.
+  static constexpr float ACTIVE_TIME = 0.5f;
+
+  /// When FALSE, Wait() never blocks and frames are rendered continuously.
+  bool m_Enabled = true;
+
+  /// Wake up the loop. Can be called from any thread.
+  void Wake();
+  /// Render next frame no later than after `seconds` (main thread only).
+  void WakeAfter(float seconds);
+  /// Keep rendering for at least ACTIVE_TIME (main thread only).
+  void KeepActive();
+
+  /**
+   * @brief Block until the next frame should be rendered (main thread only).
+   * @return Number of seconds spent waiting.
+   */
+  float Wait();
+
+private:
+  using clock = std::chrono::steady_clock;
+  clock::time_point m_activeUntil = clock::now();
+  clock::time_point m_deadline = clock::time_point::max();
+  int m_pendingFrames = 0;
+  std::atomic<bool> m_woken{false};
+};
@@ -3,15 +3,58 @@
  * @file DeviceEditor.cpp
  */
 #include "gui.h"
+#include "../capability_cache.h"
+#include <climits>
+#include <cmath>
 
 using namespace gui;
 
-DeviceEditor::DeviceEditor(DeviceMan& manager, Configuration& config)
+// Split comma separated list (xkb layouts, variants or options). Items are
+// assigned in place, so splitting the same list every frame doesn't allocate.
+static void split_list(std::string_view list, std::vector<std::string>& items) {
+  size_t count = 0;
+  size_t start = 0;
+  while (start <= list.size() && !list.empty()) {
+    size_t end = std::min(list.find(',', start), list.size());
+    if (count == items.size())
+      items.emplace_back();
+    items[count++].assign(list.substr(start, end - start));
+    start = end + 1;
+  }
+  items.resize(count);
+}
+
+static std::string join_list(const std::vector<std::string>& items) {
+  std::string list;
+  for (size_t i = 0; i < items.size(); i++)
+    list += (i ? "," : "") + items[i];
+  return list;
+}
+
+DeviceEditor::DeviceEditor(DeviceMan& manager, Configuration& config, EventLoop& event_loop)
   : m_manager(manager)
   , m_config(config)
+  , m_eventLoop(event_loop)
+  , m_managedConfig(config.app.managed_config.empty() ? ManagedConfig::DefaultPath()
+                                                      : config.app.managed_config)
+  , m_saveHint("Save the block to " + m_managedConfig.Path() +
+               "\nInclude it in sway config with: include " + m_managedConfig.Path() +
+               "\nSave preset stores the settings in the preset library instead.")
 {
   // NOTE: Assuming that the devices vector will not change during frame.
   m_device = &m_manager.m_Devices[0];
+
+  // Parsing the rules registry must not delay startup or the keyboard tab.
+  m_xkbLoading = std::async(std::launch::async, [rules = m_config.app.xkb_rules, this]() {
+    try {
+      xkb::Catalogue catalogue = xkb::Catalogue::Load(rules);
+      m_eventLoop.Wake();
+      return catalogue;
+    } catch (...) {
+      m_eventLoop.Wake();
+      throw;
+    }
+  });
 }
 
 void DeviceEditor::OnUpdate(float dt) {
@@ -24,16 +67,44 @@ void DeviceEditor::OnUpdate(float dt) {
   ImGui::SetNextWindowSize(viewport->WorkSize);
   ImGui::Begin("Fullscreen", NULL, flags);
 
-  // Device selector combo.
-  static int sel_dev = 0;
-  ImGui::Combo("Device", &sel_dev, &device_getter, &m_manager.m_Devices,
-               m_manager.m_Devices.size());
+  pollSlurp();
+
+  // Devices may be unplugged at any time.
+  if (m_manager.m_Devices.empty()) {
+    ImGui::TextDisabled("No devices connected.");
+    ImGui::End();
+    return;
+  }
+  int selected = findDevice(m_selId, m_selDevice);
+  if (selected < 0) {
+    // Selected device was unplugged, select its neighbour.
+    selected = std::clamp(m_selDevice, 0, (int)m_manager.m_Devices.size() - 1);
+    m_selId = m_manager.m_Devices[selected].sway_id;
+  }
+  m_selDevice = selected;
+
+  guiDeviceSelector();
   ImGui::Separator();
 
   // Basic device information.
-  m_device = &m_manager.m_Devices[sel_dev];
+  m_device = &m_manager.m_Devices[m_selDevice];
   ImGui::LabelText("ID", "%s", m_device->sway_id.c_str());
-  ImGui::LabelText("Type", "%s", GetTypeName(m_device->type).c_str());
+  ImGui::LabelText("Type", "%s", DEV_CAP_S[(int)m_device->type].c_str());
+  if (uint32_t rejected = m_manager.Capabilities().Rejected(m_device->sway_id)) {
+    m_rejectedNames.clear();
+    for (int s = 0; s < (int)SwaySetting::size; s++) {
+      if (!(rejected & CapabilityCache::bit(SwaySetting(s))))
+        continue;
+      if (!m_rejectedNames.empty())
+        m_rejectedNames += ", ";
+      m_rejectedNames += GetSettingName(SwaySetting(s), false);
+    }
+    ImGui::LabelText("Not applied", "%s", m_rejectedNames.c_str());
+    IMGUI_HINT(true, "Sway rejected these settings for this device, so they are no longer sent.");
+    ImGui::SameLine();
+    if (ImGui::SmallButton("Retry"))
+      m_manager.Capabilities().Forget(m_device->sway_id);
+  }
 
   // The Options and sway config tree nodes.
   ImGui::Separator();
@@ -42,33 +113,102 @@ void DeviceEditor::OnUpdate(float dt) {
     guiOptions();
     ImGui::TreePop();
   }
+  if (m_showSwayConfig) {
+    ImGui::SetNextItemOpen(m_showSwayConfig.value());
+    m_showSwayConfig.reset();
+  }
   if (ImGui::TreeNode("Sway config")) {
-    guiSwayConfig(sel_dev);
+    guiSwayConfig(m_selDevice);
     ImGui::TreePop();
   }
 
   // Apply button opening Revert popup if m_safeMode is enabled.
   ImGui::Separator();
-  static float revert_time = 0.0f;
   if (ImGui::Button("Apply")) {
-    m_manager.ApplyChanges(sel_dev);
+    m_pointerTest.Snapshot();
+    bool applied = trySway([this]() { m_manager.ApplyChanges(m_selDevice); });
 
-    if (m_config.app.safe_mode) {
-      revert_time = 0.0f;
+    if (applied && m_config.app.safe_mode) {
+      m_revertDevice = m_selDevice;
+      m_revertId = m_selId;
+      m_revertTime = 0.0f;
       ImGui::OpenPopup("Revert?");
     }
   }
-  guiRevertPopup(dt, sel_dev, revert_time);
+  guiRevertPopup(dt);
 
   // Revert button
   ImGui::SameLine();
   if (ImGui::Button("Revert")) {
-    m_manager.RestoreBackup(sel_dev);
+    trySway([this]() { m_manager.RestoreBackup(m_selDevice); });
   }
+  if (!m_swayError.empty()) {
+    ImGui::SameLine();
+    ImGui::TextDisabled("%s", m_swayError.c_str());
+  }
+  for (auto& error : m_manager.ApplyErrors())
+    ImGui::TextDisabled("%s", error.c_str());
 
   ImGui::End(); // Fullscreen window
 }
 
+void DeviceEditor::Select(int device, std::optional<Tab> tab) {
+  m_selDevice = device;
+  m_selId = m_manager.m_Devices.at(device).sway_id;
+  m_selTab = tab;
+}
+
+int DeviceEditor::findDevice(const std::string& sway_id, int hint) const {
+  const auto& devices = m_manager.m_Devices;
+  // Identical devices share the sway_id, keep the one found last time.
+  if (hint >= 0 && hint < (int)devices.size() && devices[hint].sway_id == sway_id)
+    return hint;
+  for (int i = 0; i < (int)devices.size(); i++)
+    if (devices[i].sway_id == sway_id)
+      return i;
+  return -1;
+}
+
+int DeviceEditor::tabFlags(Tab tab) const {
+  return m_selTab == tab ? ImGuiTabItemFlags_SetSelected : ImGuiTabItemFlags_None;
+}
+
+void DeviceEditor::guiDeviceSelector() {
+  m_deviceIndex.Update(m_manager);
+  const Device& selected = m_manager.m_Devices[m_selDevice];
+  if (!ImGui::BeginCombo("Device", selected.name.c_str(), ImGuiComboFlags_HeightLarge))
+    return;
+
+  if (ImGui::IsWindowAppearing())
+    ImGui::SetKeyboardFocusHere();
+  if (ImGui::InputTextWithHint("##device_query", "Search name, ID or type:...", m_deviceQuery,
+                               sizeof(m_deviceQuery)))
+    m_deviceIndex.Filter(m_deviceQuery);
+  const auto& results = m_deviceIndex.Results();
+  ImGui::TextDisabled("%d of %d devices", (int)results.size(), (int)m_manager.m_Devices.size());
+
+  // Only visible rows are submitted, so the cost does not depend on the
+  // number of devices.
+  ImGuiListClipper clipper;
+  clipper.Begin(results.size());
+  while (clipper.Step()) {
+    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+      const Device& dev = m_manager.m_Devices[results[i]];
+      ImGui::PushID(results[i]);
+      if (ImGui::Selectable(dev.name.c_str(), results[i] == m_selDevice)) {
+        m_selDevice = results[i];
+        m_selId = dev.sway_id;
+      }
+      if (results[i] == m_selDevice)
+        ImGui::SetItemDefaultFocus();
+      ImGui::SameLine();
+      ImGui::TextDisabled("%s", DEV_CAP_S[(int)dev.type].c_str());
+      ImGui::PopID();
+    }
+  }
+  ImGui::EndCombo();
+}
+
 void DeviceEditor::guiKeyboard() {
   if (m_device->repeat_delay) {
     ImGui::InputInt("Repeat delay", &m_device->repeat_delay.value(), 25, 100);
@@ -79,6 +219,10 @@ void DeviceEditor::guiKeyboard() {
     ImGui::InputInt("Repeat rate", &m_device->repeat_rate.value(), 1, 5);
     IMGUI_HINT(true, "Number of characters to repeat per second");
   }
+  if (m_device->repeat_delay && m_device->repeat_rate && ImGui::TreeNode("Repeat test")) {
+    m_keyRepeat.OnUpdate(m_device->repeat_delay.value(), m_device->repeat_rate.value());
+    ImGui::TreePop();
+  }
   const auto& imgui_xkb_capslock = [this]() {
     ImGui::SameLine();
     ImGui::Checkbox("xkb capslock", &m_device->xkb_capslock.value());
@@ -94,6 +238,149 @@ void DeviceEditor::guiKeyboard() {
   };
   if (m_device->xkb_numlock)
     opt_toggle("##xkb_numlock", m_device->xkb_numlock, imgui_xkb_numlock);
+
+  if (m_device->xkb_layout)
+    guiXkb();
+}
+
+void DeviceEditor::guiXkb() {
+  if (!m_xkb && m_xkbError.empty()) {
+    if (m_xkbLoading.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      ImGui::TextDisabled("Loading keyboard layouts...");
+      return;
+    }
+    try {
+      m_xkb = m_xkbLoading.get();
+      m_layoutResults = m_xkb->Search(xkb::Kind::layout, m_layoutQuery);
+      m_optionResults = m_xkb->Search(xkb::Kind::option, m_optionQuery);
+    } catch (const std::exception& e) {
+      m_xkbError = e.what();
+    }
+  }
+  if (!m_xkb) {
+    ImGui::TextDisabled("Keyboard layouts are not available: %s", m_xkbError.c_str());
+    return;
+  }
+
+  opt_toggle("##xkb_layout", m_device->xkb_layout, [this]() {
+    std::string& layout = m_device->xkb_layout.value();
+    ImGui::SameLine();
+    ImGui::Text("xkb layout: %s", layout.empty() ? "(default)" : layout.c_str());
+    IMGUI_HINT(true, "Click to select the layout, Ctrl+click to add it");
+    ImGui::Indent();
+    if (ImGui::InputTextWithHint("##layout_query", "Search layouts", m_layoutQuery,
+                                 sizeof(m_layoutQuery)))
+      m_layoutResults = m_xkb->Search(xkb::Kind::layout, m_layoutQuery);
+    if (ImGui::BeginListBox("##layouts")) {
+      split_list(layout, m_layoutItems);
+      const auto& layouts = m_layoutItems;
+      ImGuiListClipper clipper;
+      clipper.Begin(m_layoutResults.size());
+      while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+          const xkb::Item& item = m_xkb->Items(xkb::Kind::layout)[m_layoutResults[i]];
+          const char* name = m_xkb->Name(item);
+          bool selected = std::find(layouts.begin(), layouts.end(), name) != layouts.end();
+          ImGui::PushID(i);
+          if (ImGui::Selectable(name, selected)) {
+            // Variants are matched to layouts by position.
+            if (ImGui::GetIO().KeyCtrl && !layout.empty() && !selected) {
+              layout += std::string(",") + name;
+              if (m_device->xkb_variant)
+                m_device->xkb_variant.value() += ",";
+            } else {
+              layout = name;
+              if (m_device->xkb_variant)
+                m_device->xkb_variant = std::string();
+            }
+          }
+          ImGui::SameLine();
+          ImGui::TextDisabled("%s", m_xkb->Description(item));
+          ImGui::PopID();
+        }
+      }
+      ImGui::EndListBox();
+    }
+    ImGui::Unindent();
+  });
+
+  if (m_device->xkb_variant) {
+    opt_toggle("##xkb_variant", m_device->xkb_variant, [this]() {
+      ImGui::SameLine();
+      ImGui::Text("xkb variant");
+      ImGui::Indent();
+      split_list(m_device->xkb_layout.value(), m_layoutItems);
+      split_list(m_device->xkb_variant.value(), m_variantItems);
+      const auto& layouts = m_layoutItems;
+      auto& variants = m_variantItems;
+      variants.resize(layouts.size());
+      bool changed = false;
+      for (size_t i = 0; i < layouts.size(); i++) {
+        const xkb::Item* layout = m_xkb->FindLayout(layouts[i]);
+        if (!layout)
+          continue;
+        ImGui::PushID(i);
+        if (ImGui::BeginCombo(layouts[i].c_str(),
+                              variants[i].empty() ? "(default)" : variants[i].c_str())) {
+          if (ImGui::Selectable("(default)", variants[i].empty())) {
+            variants[i].clear();
+            changed = true;
+          }
+          for (uint32_t v = layout->first; v < layout->first + layout->count; v++) {
+            const xkb::Item& variant = m_xkb->Items(xkb::Kind::variant)[v];
+            if (ImGui::Selectable(m_xkb->Description(variant), variants[i] == m_xkb->Name(variant))) {
+              variants[i] = m_xkb->Name(variant);
+              changed = true;
+            }
+          }
+          ImGui::EndCombo();
+        }
+        ImGui::PopID();
+      }
+      if (changed)
+        m_device->xkb_variant = join_list(variants);
+      ImGui::Unindent();
+    });
+  }
+
+  if (m_device->xkb_options) {
+    opt_toggle("##xkb_options", m_device->xkb_options, [this]() {
+      std::string& options = m_device->xkb_options.value();
+      ImGui::SameLine();
+      ImGui::TextWrapped("xkb options: %s", options.empty() ? "(none)" : options.c_str());
+      ImGui::Indent();
+      if (ImGui::InputTextWithHint("##option_query", "Search options", m_optionQuery,
+                                   sizeof(m_optionQuery)))
+        m_optionResults = m_xkb->Search(xkb::Kind::option, m_optionQuery);
+      if (ImGui::BeginListBox("##options")) {
+        split_list(options, m_optionItems);
+        auto& enabled = m_optionItems;
+        ImGuiListClipper clipper;
+        clipper.Begin(m_optionResults.size());
+        while (clipper.Step()) {
+          for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            const xkb::Item& item = m_xkb->Items(xkb::Kind::option)[m_optionResults[i]];
+            const char* name = m_xkb->Name(item);
+            auto it = std::find(enabled.begin(), enabled.end(), name);
+            ImGui::PushID(i);
+            if (ImGui::Selectable(m_xkb->Description(item), it != enabled.end())) {
+              if (it != enabled.end())
+                enabled.erase(it);
+              else
+                enabled.push_back(name);
+              options = join_list(enabled);
+            }
+            if (ImGui::IsItemHovered())
+              ImGui::SetTooltip("%s\n%s", name,
+                                m_xkb->Description(m_xkb->Items(xkb::Kind::group)[item.parent]));
+            ImGui::PopID();
+          }
+        }
+        ImGui::EndListBox();
+      }
+      ImGui::Unindent();
+    });
+  }
 }
 
 void DeviceEditor::guiTablet() {
@@ -124,15 +411,93 @@ void DeviceEditor::guiMapping() {
       ImGui::Text("Map to region");
       ImGui::Indent();
       ImGui::InputInt4("Region", m_device->map_to_region.value().data());
-      if (ImGui::Button("Select"))
-        callSlurp(m_device->map_to_region.value().data());
-      IMGUI_HINT(true, "Requires slurp to be installed");
+      guiRegionPicker();
+      if (m_slurp.Running()) {
+        ImGui::TextDisabled("Selecting...");
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel"))
+          m_slurp.Cancel();
+      } else {
+        if (ImGui::Button("Select") && m_slurp.Start())
+          m_slurpDevice = m_device->sway_id;
+        IMGUI_HINT(true, "Requires slurp to be installed");
+        if (!m_slurp.Error().empty())
+          ImGui::TextDisabled("%s", m_slurp.Error().c_str());
+      }
       ImGui::Unindent();
     };
     opt_toggle("##map_to_region", m_device->map_to_region, imgui_map_to_region);
   }
 }
 
+void DeviceEditor::guiRegionPicker() {
+  // Bounding box of the active outputs in layout coordinates.
+  int min_x = INT_MAX, min_y = INT_MAX, max_x = INT_MIN, max_y = INT_MIN;
+  for (auto& out : m_manager.m_Outputs) {
+    if (!out.active || out.width <= 0 || out.height <= 0)
+      continue;
+    min_x = std::min(min_x, out.x);
+    min_y = std::min(min_y, out.y);
+    max_x = std::max(max_x, out.x + out.width);
+    max_y = std::max(max_y, out.y + out.height);
+  }
+  if (min_x >= max_x || min_y >= max_y) {
+    ImGui::TextDisabled("No active outputs.");
+    return;
+  }
+
+  float scale = std::min(ImGui::GetContentRegionAvail().x / (max_x - min_x),
+                         REGION_PICKER_HEIGHT / (max_y - min_y));
+  ImVec2 origin = ImGui::GetCursorScreenPos();
+  const auto& to_screen = [&](float x, float y) {
+    return ImVec2(origin.x + (x - min_x) * scale, origin.y + (y - min_y) * scale);
+  };
+  const auto& to_layout = [&](ImVec2 p) {
+    return ImVec2(std::clamp((p.x - origin.x) / scale + min_x, float(min_x), float(max_x)),
+                  std::clamp((p.y - origin.y) / scale + min_y, float(min_y), float(max_y)));
+  };
+
+  ImGui::InvisibleButton("##region_picker", ImVec2((max_x - min_x) * scale, (max_y - min_y) * scale));
+  IMGUI_HINT(true, "Drag to select region, click to select whole output");
+
+  auto& region = m_device->map_to_region.value();
+  ImVec2 mouse = to_layout(ImGui::GetMousePos());
+  if (ImGui::IsItemActivated())
+    m_regionDrag = mouse;
+  if (m_regionDrag && ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left)) {
+    region = {int(std::min(m_regionDrag->x, mouse.x)), int(std::min(m_regionDrag->y, mouse.y)),
+              int(std::abs(mouse.x - m_regionDrag->x)), int(std::abs(mouse.y - m_regionDrag->y))};
+  } else if (m_regionDrag && ImGui::IsItemDeactivated()) {
+    // Click without dragging selects the output under cursor.
+    if (std::abs(mouse.x - m_regionDrag->x) * scale < 3.0f &&
+        std::abs(mouse.y - m_regionDrag->y) * scale < 3.0f) {
+      for (auto& out : m_manager.m_Outputs)
+        if (out.active && mouse.x >= out.x && mouse.x < out.x + out.width &&
+            mouse.y >= out.y && mouse.y < out.y + out.height)
+          region = {out.x, out.y, out.width, out.height};
+    }
+    m_regionDrag.reset();
+  }
+
+  ImDrawList* draw_list = ImGui::GetWindowDrawList();
+  for (auto& out : m_manager.m_Outputs) {
+    if (!out.active)
+      continue;
+    ImVec2 min = to_screen(out.x, out.y);
+    ImVec2 max = to_screen(out.x + out.width, out.y + out.height);
+    draw_list->AddRectFilled(min, max, ImGui::GetColorU32(ImGuiCol_FrameBg));
+    draw_list->AddRect(min, max, ImGui::GetColorU32(ImGuiCol_Border));
+    draw_list->AddText(ImVec2(min.x + 4.0f, min.y + 2.0f), ImGui::GetColorU32(ImGuiCol_Text),
+                       out.name.c_str());
+  }
+  if (region[2] > 0 && region[3] > 0) {
+    ImVec2 min = to_screen(region[0], region[1]);
+    ImVec2 max = to_screen(region[0] + region[2], region[1] + region[3]);
+    draw_list->AddRectFilled(min, max, ImGui::GetColorU32(ImGuiCol_TextSelectedBg));
+    draw_list->AddRect(min, max, ImGui::GetColorU32(ImGuiCol_PlotHistogram));
+  }
+}
+
 void DeviceEditor::guiLibInput() {
   ImGui::Checkbox("Send events", &m_device->send_events);
   IMGUI_HINT(true, "Enable/Disable this device");
@@ -196,34 +561,40 @@ void DeviceEditor::guiLibInput() {
     IMGUI_HINT(
         true, "adaptive - Accelerative movement\n    flat - Linear movement");
   }
+  if ((m_device->type == DevType::pointer || m_device->type == DevType::touchpad) &&
+      ImGui::TreeNode("Pointer test")) {
+    m_pointerTest.OnUpdate();
+    ImGui::TreePop();
+  }
 }
 
 void DeviceEditor::guiOptions() {
   if (ImGui::BeginTabBar("TapBar options")) {
     if (m_device->type == DevType::keyboard) {
-      if (ImGui::BeginTabItem("Keyboard")) {
+      if (ImGui::BeginTabItem("Keyboard", nullptr, tabFlags(Tab::keyboard))) {
         guiKeyboard();
         ImGui::EndTabItem();
       }
     }
     if (m_device->type == DevType::tablet_tool) {
-      if (ImGui::BeginTabItem("Tablet")) {
+      if (ImGui::BeginTabItem("Tablet", nullptr, tabFlags(Tab::tablet))) {
         guiTablet();
         ImGui::EndTabItem();
       }
     }
     if (m_device->map_to_output || m_device->map_to_region) {
-      if (ImGui::BeginTabItem("Mapping")) {
+      if (ImGui::BeginTabItem("Mapping", nullptr, tabFlags(Tab::mapping))) {
         guiMapping();
         ImGui::EndTabItem();
       }
     }
     ImGui::SetNextItemOpen(true, ImGuiCond_FirstUseEver);
-    if (ImGui::BeginTabItem("Libinput")) {
+    if (ImGui::BeginTabItem("Libinput", nullptr, tabFlags(Tab::libinput))) {
       guiLibInput();
       ImGui::EndTabItem();
     }
     ImGui::EndTabBar();
+    m_selTab.reset();
   }
 }
 
@@ -231,12 +602,13 @@ void DeviceEditor::guiSwayConfig(int selected_device) {
   static bool match_type = false;
   ImGui::Checkbox("Match type", &match_type);
 
-  std::string config = m_manager.GetSwayConfig(selected_device, match_type);
+  m_swayConfig.clear();
+  m_manager.AppendSwayConfig(selected_device, m_swayConfig, match_type);
   static bool copy = false;
 
   if (copy)
     ImGui::LogToClipboard();
-  ImGui::TextWrapped("%s", config.c_str());
+  ImGui::TextWrapped("%s", m_swayConfig.c_str());
   if (copy) {
     ImGui::LogFinish();
     copy = false;
@@ -250,57 +622,107 @@ void DeviceEditor::guiSwayConfig(int selected_device) {
   ImGui::Spacing();
   if (ImGui::Button("Copy"))
     copy = true;
+
+  // Only this block is replaced in the managed file.
+  ImGui::SameLine();
+  if (ImGui::Button("Save")) {
+    const Device& dev = m_manager.m_Devices[selected_device];
+    std::string id = match_type ? "type:" + GetTypeName(dev.type) : dev.sway_id;
+    m_managedConfig.Set(id, m_swayConfig);
+    try {
+      m_managedStatus = m_managedConfig.Save() ? "Saved." : "Already up to date.";
+    } catch (const std::exception& e) {
+      m_managedStatus = e.what();
+    }
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Save preset")) {
+    try {
+      m_manager.SavePreset(selected_device, match_type);
+      m_managedStatus = "Preset saved.";
+    } catch (const std::exception& e) {
+      m_managedStatus = e.what();
+    }
+  }
+  IMGUI_HINT(true, m_saveHint.c_str());
+  if (!m_managedStatus.empty()) {
+    ImGui::SameLine();
+    ImGui::TextDisabled("%s", m_managedStatus.c_str());
+  }
   ImGui::Spacing();
 }
 
-void DeviceEditor::guiRevertPopup(float dt, int selected_device, float& current_timeout) {
+void DeviceEditor::guiRevertPopup(float dt) {
   // Always center this window when appearing
   ImVec2 center = ImGui::GetMainViewport()->GetCenter();
   ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
 
   if (ImGui::BeginPopupModal("Revert?", NULL, ImGuiWindowFlags_AlwaysAutoResize)) {
-    ImGui::Text("Changes will be\nreverted after: %4.1fs\n\n",
-                m_config.app.revert_timeout - current_timeout);
-
-    current_timeout += dt;
-    if (current_timeout >= m_config.app.revert_timeout) {
-      m_manager.RevertChanges(selected_device);
+    // Unplugged device has nothing to revert, don't revert another one.
+    int selected_device = findDevice(m_revertId, m_revertDevice);
+    if (selected_device < 0) {
       ImGui::CloseCurrentPopup();
+      ImGui::EndPopup();
+      return;
     }
+    m_revertDevice = selected_device;
+
+    float remaining = m_config.app.revert_timeout - m_revertTime;
+    ImGui::Text("Changes will be\nreverted after: %4.1fs\n\n", remaining);
+
+    // Redraw when the shown value changes (it has 0.1s precision).
+    float tick = std::fmod(remaining, 0.1f);
+    m_eventLoop.WakeAfter(tick > 0.001f ? tick : 0.1f);
+
+    // Failed revert is tried again after a while until it succeeds or the
+    // user keeps the changes, the device may be unusable until then.
+    constexpr float RETRY_TIMEOUT = 1.0f;
+    m_revertTime += dt;
+    if (m_revertTime >= m_config.app.revert_timeout) {
+      if (trySway([&]() { m_manager.RevertChanges(selected_device); }))
+        ImGui::CloseCurrentPopup();
+      else
+        m_revertTime = m_config.app.revert_timeout - RETRY_TIMEOUT;
+    }
+    if (!m_swayError.empty())
+      ImGui::TextDisabled("%s", m_swayError.c_str());
     ImGui::Separator();
 
     if (ImGui::Button("Keep"))
       ImGui::CloseCurrentPopup();
     ImGui::SameLine();
     ImGui::SetItemDefaultFocus();
-    if (ImGui::Button("Revert")) {
-      m_manager.RevertChanges(selected_device);
+    if (ImGui::Button("Revert") && trySway([&]() { m_manager.RevertChanges(selected_device); }))
       ImGui::CloseCurrentPopup();
-    }
 
     ImGui::EndPopup();
   }
 }
 
-bool DeviceEditor::callSlurp(int* out) {
-  FILE* slurp = popen("slurp -f '%x %y %w %h' 2>&1", "r");
-  if (!slurp)
-    return false;
-
-  char out_line[100] = {};
-  fgets(out_line, sizeof(out_line), slurp);
-  std::string line(out_line);
-
-  if (strstr(out_line, "cancelled")) {
-    pclose(slurp);
+bool DeviceEditor::trySway(const std::function<void()>& send) {
+  // Sway may be wedged, the request fails after its timeout instead of
+  // freezing the editor.
+  try {
+    send();
+  } catch (const std::exception& e) {
+    // Also malformed replies (json exceptions), not only failed requests.
+    m_swayError = e.what();
     return false;
   }
-
-  std::istringstream is(line);
-  for (int i = 0; i < 4; i++)
-    is >> out[i];
-
-  pclose(slurp);
+  m_swayError.clear();
   return true;
 }
 
+void DeviceEditor::pollSlurp() {
+  if (!m_slurp.Running())
+    return;
+  // The pipe is not watched by the event loop, so check it regularly.
+  m_eventLoop.WakeAfter(0.05f);
+
+  std::array<int, 4> region;
+  if (!m_slurp.Poll(region.data()))
+    return;
+  for (auto& dev : m_manager)
+    if (dev.sway_id == m_slurpDevice && dev.map_to_region)
+      dev.map_to_region = region;
+}
@@ -0,0 +1,96 @@
+/**
+ * @brief Definition of gui::KeyRepeatAnalyzer methods
+ * @file KeyRepeatAnalyzer.cpp
+ */
+#include "gui.h"
+#include <algorithm>
+
+using namespace gui;
+
+namespace {
+  KeyRepeatAnalyzer* g_analyzer = nullptr;
+  GLFWkeyfun g_prevCallback = nullptr;
+  bool g_installed = false;
+
+  void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    // Timestamp first, before anything else delays it.
+    double time = glfwGetTime();
+    if (g_analyzer)
+      g_analyzer->OnKey(key, action, time);
+    if (g_prevCallback)
+      g_prevCallback(window, key, scancode, action, mods);
+  }
+}
+
+KeyRepeatAnalyzer::~KeyRepeatAnalyzer() {
+  // The callback stays installed, but only passes events through.
+  if (g_analyzer == this)
+    g_analyzer = nullptr;
+}
+
+void KeyRepeatAnalyzer::OnKey(int key, int action, double time) {
+  if (!m_capturing)
+    return;
+  if (action == GLFW_PRESS) {
+    m_key = key;
+    m_pressTime = m_lastTime = time;
+    m_delay = 0.0f;
+    m_intervals.Clear();
+    m_dirty = true;
+  } else if (action == GLFW_REPEAT && key == m_key) {
+    if (m_delay == 0.0f)
+      m_delay = float((time - m_pressTime) * 1000.0);
+    else
+      m_intervals.Push(float((time - m_lastTime) * 1000.0));
+    m_lastTime = time;
+    m_dirty = true;
+  } else if (action == GLFW_RELEASE && key == m_key) {
+    m_key = -1;
+  }
+}
+
+void KeyRepeatAnalyzer::OnUpdate(int delay, int rate) {
+  if (ImGui::Button(m_capturing ? "Stop" : "Start")) {
+    if (!g_installed) {
+      if (GLFWwindow* window = glfwGetCurrentContext()) {
+        g_prevCallback = glfwSetKeyCallback(window, key_callback);
+        g_installed = true;
+      } else {
+        m_error = "No window to capture keys from.";
+      }
+    }
+    g_analyzer = this;
+    m_capturing = g_installed && !m_capturing;
+    m_key = -1;
+  }
+  IMGUI_HINT(true, "Start the test and hold any key (except Escape). Delay and interval of "
+                   "repeated key events are measured as applications receive them, so "
+                   "they include event dispatch; Apply changes and hold the key again to compare.");
+  if (!m_error.empty())
+    ImGui::TextDisabled("%s", m_error.c_str());
+  if (m_capturing)
+    ImGui::TextDisabled(m_key >= 0 ? "Measuring..." : "Hold a key.");
+
+  // Summary is computed only when new events came.
+  if (m_dirty) {
+    size_t count = m_intervals.Size();
+    for (size_t i = 0; i < count; i++)
+      m_plot[i] = m_intervals[i];
+    std::array<float, HISTORY> sorted;
+    std::copy_n(m_plot.begin(), count, sorted.begin());
+    m_summary = input::summarize(std::span(sorted.data(), count));
+    m_dirty = false;
+  }
+
+  float interval = rate > 0 ? 1000.0f / rate : 0.0f;
+  if (m_delay > 0.0f)
+    ImGui::Text("Delay:    %7.1f ms (set %d ms)", m_delay, delay);
+  if (m_summary.count == 0)
+    return;
+  ImGui::Text("Interval: %7.2f ms (set %.2f ms, %d/s)", m_summary.mean, interval, rate);
+  ImGui::Text("Jitter:   %7.2f ms, p99 %.2f ms, max %.2f ms", m_summary.jitter,
+              m_summary.p99, m_summary.max);
+  ImGui::Text("Rate:     %7.1f /s over %zu repeats", 1000.0 / m_summary.mean, m_summary.count);
+  ImGui::PlotLines("##intervals", m_plot.data(), m_summary.count, 0, "Repeat interval [ms]",
+                   0.0f, std::max<float>(m_summary.max, interval) * 1.5f, ImVec2(0, 60));
+}
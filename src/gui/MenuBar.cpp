@@ -6,7 +6,12 @@
 
 using namespace gui;
 
+MenuBar::MenuBar(PerfOverlay& perf_overlay) : m_perfOverlay(perf_overlay) {}
+
 void MenuBar::OnUpdate(float) {
+  if (ImGui::IsKeyPressed(ImGuiKey_F12, false))
+    m_perfOverlay.m_Visible = !m_perfOverlay.m_Visible;
+
   if (ImGui::BeginMainMenuBar()) {
     if (ImGui::BeginMenu("File")) {
       if (ImGui::MenuItem("New preset..")) {};
@@ -29,6 +34,11 @@ void MenuBar::OnUpdate(float) {
       ImGui::EndMenu();
     }
 
+    if (ImGui::BeginMenu("View")) {
+      ImGui::MenuItem("Performance", "F12", &m_perfOverlay.m_Visible);
+      ImGui::EndMenu();
+    }
+
     ImGui::EndMainMenuBar();
   }
 }
@@ -0,0 +1,115 @@
+/**
+ * @brief Definition of gui::PerfOverlay methods
+ * @file PerfOverlay.cpp
+ */
+#include "gui.h"
+
+using namespace gui;
+
+void PerfOverlay::OnUpdate(float dt) {
+  // Idle wait is part of dt, but not of the time the frame took.
+  float busy = std::max(0.0f, dt - m_Waited);
+  perf::stats().frame.Record(uint64_t(busy * 1e6f));
+  m_frameTimes[m_frameOffset] = busy * 1000.0f;
+  m_frameOffset = (m_frameOffset + 1) % FRAME_HISTORY;
+
+  if (!m_Visible)
+    return;
+
+  const ImGuiViewport* viewport = ImGui::GetMainViewport();
+  ImGui::SetNextWindowPos(ImVec2(viewport->WorkPos.x + viewport->WorkSize.x, viewport->WorkPos.y),
+                          ImGuiCond_FirstUseEver, ImVec2(1.0f, 0.0f));
+  ImGui::SetNextWindowBgAlpha(0.9f);
+  if (!ImGui::Begin("Performance", &m_Visible, ImGuiWindowFlags_AlwaysAutoResize |
+                                               ImGuiWindowFlags_NoSavedSettings |
+                                               ImGuiWindowFlags_NoFocusOnAppearing)) {
+    ImGui::End();
+    return;
+  }
+
+  auto& stats = perf::stats();
+  ImGui::Text("Frame: %6.2f ms (%5.1f FPS)", busy * 1000.0f, dt > 0.0f ? 1.0f / dt : 0.0f);
+  ImGui::PlotLines("##frame_times", m_frameTimes.data(), FRAME_HISTORY, m_frameOffset,
+                   "Frame time [ms]", 0.0f, 50.0f, ImVec2(0, 50));
+
+  ImGui::Separator();
+  ImGui::Text("IPC requests: %llu", (unsigned long long)stats.ipc_requests.Get());
+  ImGui::Text("IPC sent:     %llu B", (unsigned long long)stats.ipc_bytes_out.Get());
+  ImGui::Text("IPC received: %llu B", (unsigned long long)stats.ipc_bytes_in.Get());
+  ImGui::Text("IPC slow:     %llu", (unsigned long long)stats.ipc_slow.Get());
+  ImGui::Text("IPC timeouts: %llu", (unsigned long long)stats.ipc_timeouts.Get());
+
+  ImGui::Separator();
+  if (ImGui::BeginTable("##latencies", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit)) {
+    ImGui::TableSetupColumn("Latency");
+    ImGui::TableSetupColumn("Count");
+    ImGui::TableSetupColumn("p50 [ms]");
+    ImGui::TableSetupColumn("p99 [ms]");
+    ImGui::TableSetupColumn("Max [ms]");
+    ImGui::TableHeadersRow();
+    guiHistogram("Frame", stats.frame);
+    guiHistogram("Editor CPU", stats.editor);
+    guiHistogram("Apply", stats.apply);
+    guiHistogram("Revert", stats.revert);
+    guiHistogram("Discovery", stats.discovery);
+    guiHistogram("IPC reply", stats.ipc_latency);
+    ImGui::EndTable();
+  }
+
+  ImGui::Separator();
+  if (!perf::ALLOC_STATS) {
+    ImGui::TextDisabled("Allocations are not counted (build with -Dalloc_stats=true)");
+  } else {
+    ImGui::Text("Allocations per frame: p50 %.0f, max %llu", stats.frame_allocs.Percentile(0.50),
+                (unsigned long long)stats.frame_allocs.Max());
+    if (ImGui::BeginTable("##allocs", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit)) {
+      ImGui::TableSetupColumn("Subsystem");
+      ImGui::TableSetupColumn("Allocations");
+      ImGui::TableSetupColumn("Bytes");
+      ImGui::TableHeadersRow();
+      for (int i = 0; i < (int)perf::Subsystem::size; i++) {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(perf::SUBSYSTEM_S[i]);
+        ImGui::TableNextColumn();
+        ImGui::Text("%llu", (unsigned long long)stats.allocs[i].count.Get());
+        ImGui::TableNextColumn();
+        ImGui::Text("%llu", (unsigned long long)stats.allocs[i].bytes.Get());
+      }
+      ImGui::EndTable();
+    }
+  }
+
+  if (ImGui::Button("Reset"))
+    stats.Reset();
+
+  ImGui::End();
+}
+
+void PerfOverlay::guiHistogram(const char* label, const perf::Histogram& hist) {
+  ImGui::TableNextRow();
+  ImGui::TableNextColumn();
+  ImGui::TextUnformatted(label);
+
+  // Show bucket distribution when hovering over the label.
+  if (ImGui::IsItemHovered()) {
+    auto buckets = hist.Buckets();
+    std::array<float, perf::Histogram::BUCKETS> values;
+    for (int i = 0; i < perf::Histogram::BUCKETS; i++)
+      values[i] = float(buckets[i]);
+    ImGui::BeginTooltip();
+    ImGui::Text("%s (log2 us buckets)", label);
+    ImGui::PlotHistogram("##buckets", values.data(), values.size(), 0, nullptr,
+                         0.0f, 3.4e38f, ImVec2(300, 80));
+    ImGui::EndTooltip();
+  }
+
+  ImGui::TableNextColumn();
+  ImGui::Text("%llu", (unsigned long long)hist.Count());
+  ImGui::TableNextColumn();
+  ImGui::Text("%.2f", hist.Percentile(0.50) / 1000.0);
+  ImGui::TableNextColumn();
+  ImGui::Text("%.2f", hist.Percentile(0.99) / 1000.0);
+  ImGui::TableNextColumn();
+  ImGui::Text("%.2f", hist.Max() / 1000.0);
+}
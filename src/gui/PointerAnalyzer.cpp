@@ -0,0 +1,174 @@
+/**
+ * @brief Definition of gui::PointerAnalyzer methods
+ * @file PointerAnalyzer.cpp
+ */
+#include "gui.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace gui;
+
+namespace {
+  PointerAnalyzer* g_analyzer = nullptr;
+  GLFWcursorposfun g_prevCursorPos = nullptr;
+  GLFWscrollfun g_prevScroll = nullptr;
+  bool g_installed = false;
+
+  void cursor_pos_callback(GLFWwindow* window, double x, double y) {
+    double time = glfwGetTime();
+    if (g_analyzer)
+      g_analyzer->OnMotion(x, y, time);
+    if (g_prevCursorPos)
+      g_prevCursorPos(window, x, y);
+  }
+
+  void scroll_callback(GLFWwindow* window, double dx, double dy) {
+    double time = glfwGetTime();
+    if (g_analyzer)
+      g_analyzer->OnScroll(dx, dy, time);
+    if (g_prevScroll)
+      g_prevScroll(window, dx, dy);
+  }
+}
+
+PointerAnalyzer::~PointerAnalyzer() {
+  // The callbacks stay installed, but only pass events through.
+  if (g_analyzer == this)
+    g_analyzer = nullptr;
+}
+
+void PointerAnalyzer::OnMotion(double x, double y, double time) {
+  if (!m_capturing)
+    return;
+  double dt = time - m_lastTime;
+  if (m_lastTime < 0.0 || dt > STROKE_GAP) {
+    endStroke();
+    m_strokeStart = time;
+  } else {
+    m_intervals.Push(float(dt * 1000.0));
+    m_distance += std::hypot(x - m_lastX, y - m_lastY);
+    m_dirty = true;
+  }
+  m_lastTime = time;
+  m_lastX = x;
+  m_lastY = y;
+}
+
+void PointerAnalyzer::OnScroll(double dx, double dy, double) {
+  if (!m_capturing)
+    return;
+  m_scrollEvents++;
+  m_scrollSum += std::hypot(dx, dy);
+}
+
+void PointerAnalyzer::endStroke() {
+  double duration = m_lastTime - m_strokeStart;
+  // Ignore twitches too short to have a meaningful velocity.
+  if (duration > 0.02 && m_distance > 1.0)
+    m_strokes.Push({float(m_distance / duration), float(m_distance)});
+  m_distance = 0.0;
+}
+
+void PointerAnalyzer::Snapshot() {
+  if (m_strokes.Empty())
+    return;
+  m_reference = m_strokes;
+  m_strokes.Clear();
+}
+
+void PointerAnalyzer::OnUpdate() {
+  if (ImGui::Button(m_capturing ? "Stop" : "Start")) {
+    if (!g_installed) {
+      if (GLFWwindow* window = glfwGetCurrentContext()) {
+        g_prevCursorPos = glfwSetCursorPosCallback(window, cursor_pos_callback);
+        g_prevScroll = glfwSetScrollCallback(window, scroll_callback);
+        g_installed = true;
+      } else {
+        m_error = "No window to capture pointer from.";
+      }
+    }
+    g_analyzer = this;
+    m_capturing = g_installed && !m_capturing;
+    m_lastTime = -1.0;
+  }
+  IMGUI_HINT(true, "Start the test and move the pointer over this window in strokes of "
+                   "the same physical length, slow and fast. Strokes measured before "
+                   "Apply are kept as reference (gray).");
+  ImGui::SameLine();
+  if (ImGui::Button("Clear")) {
+    m_intervals.Clear();
+    m_strokes.Clear();
+    m_reference.Clear();
+    m_scrollEvents = 0;
+    m_scrollSum = 0.0;
+    m_summary = {};
+  }
+  if (!m_error.empty())
+    ImGui::TextDisabled("%s", m_error.c_str());
+
+  // Stroke in progress ends after a pause even without further events.
+  if (m_capturing && m_lastTime >= 0.0 && glfwGetTime() - m_lastTime > STROKE_GAP) {
+    endStroke();
+    m_lastTime = -1.0;
+  }
+
+  // Summary is computed only when new events came.
+  if (m_dirty) {
+    size_t count = m_intervals.Size();
+    for (size_t i = 0; i < count; i++)
+      m_plot[i] = m_intervals[i];
+    std::array<float, HISTORY> sorted;
+    std::copy_n(m_plot.begin(), count, sorted.begin());
+    m_summary = input::summarize(std::span(sorted.data(), count));
+    m_dirty = false;
+  }
+
+  if (m_summary.count > 0) {
+    ImGui::Text("Event rate: %7.1f Hz over %zu events", 1000.0 / m_summary.mean, m_summary.count);
+    ImGui::PlotLines("##intervals", m_plot.data(), m_summary.count, 0, "Dispatch interval [ms]",
+                     0.0f, float(m_summary.p99) * 2.0f, ImVec2(0, 50));
+    IMGUI_HINT(true, "Events are timestamped when they are dispatched to swic, in batches "
+                     "once per frame. Single intervals therefore show frame pacing, not "
+                     "the report timing of the device. Only the mean rate is meaningful.");
+  }
+  if (m_scrollEvents > 0)
+    ImGui::Text("Scroll:     %llu events, mean step %.2f", (unsigned long long)m_scrollEvents,
+                m_scrollSum / m_scrollEvents);
+  guiStrokes();
+}
+
+void PointerAnalyzer::guiStrokes() {
+  if (m_strokes.Empty() && m_reference.Empty())
+    return;
+
+  float max_v = 1.0f, max_d = 1.0f;
+  for (auto* strokes : {&m_strokes, &m_reference})
+    for (size_t i = 0; i < strokes->Size(); i++) {
+      max_v = std::max(max_v, (*strokes)[i].velocity);
+      max_d = std::max(max_d, (*strokes)[i].displacement);
+    }
+
+  ImVec2 origin = ImGui::GetCursorScreenPos();
+  ImVec2 size(ImGui::GetContentRegionAvail().x, PLOT_HEIGHT);
+  ImGui::InvisibleButton("##strokes", size);
+  const auto& to_screen = [&](const Stroke& s) {
+    return ImVec2(origin.x + s.velocity / max_v * (size.x - 4.0f) + 2.0f,
+                  origin.y + size.y - s.displacement / max_d * (size.y - 4.0f) - 2.0f);
+  };
+
+  ImDrawList* draw_list = ImGui::GetWindowDrawList();
+  draw_list->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y),
+                           ImGui::GetColorU32(ImGuiCol_FrameBg));
+  for (size_t i = 0; i < m_reference.Size(); i++)
+    draw_list->AddCircleFilled(to_screen(m_reference[i]), 2.5f, ImGui::GetColorU32(ImGuiCol_TextDisabled));
+  for (size_t i = 0; i < m_strokes.Size(); i++)
+    draw_list->AddCircleFilled(to_screen(m_strokes[i]), 2.5f, ImGui::GetColorU32(ImGuiCol_PlotLines));
+
+  char label[64];
+  snprintf(label, sizeof(label), "displacement (max %.0f px)", max_d);
+  draw_list->AddText(ImVec2(origin.x + 4.0f, origin.y + 2.0f), ImGui::GetColorU32(ImGuiCol_Text), label);
+  snprintf(label, sizeof(label), "velocity (max %.0f px/s)", max_v);
+  draw_list->AddText(ImVec2(origin.x + size.x - ImGui::CalcTextSize(label).x - 4.0f,
+                            origin.y + size.y - ImGui::GetTextLineHeight() - 2.0f),
+                     ImGui::GetColorU32(ImGuiCol_Text), label);
+}
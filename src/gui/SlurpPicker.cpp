@@ -0,0 +1,74 @@
+/**
+ * @brief Definition of gui::SlurpPicker methods
+ * @file SlurpPicker.cpp
+ */
+#include "gui.h"
+#include <csignal>
+#include <sstream>
+#include <system_error>
+
+using namespace gui;
+
+SlurpPicker::~SlurpPicker() {
+  Cancel();
+}
+
+bool SlurpPicker::Start() {
+  if (Running())
+    return false;
+  m_output.clear();
+  m_error.clear();
+
+  // Both stdout and stderr are captured (slurp reports cancellation on
+  // stderr).
+  try {
+    m_process.emplace(std::vector<std::string>{"slurp", "-f", "%x %y %w %h"}, true);
+  } catch (const std::system_error& e) {
+    m_error = e.code() == std::errc::no_such_file_or_directory ? "slurp is not installed."
+                                                               : "Failed to start slurp.";
+    return false;
+  }
+  m_start = std::chrono::steady_clock::now();
+  return true;
+}
+
+void SlurpPicker::Cancel() {
+  if (!Running())
+    return;
+  m_process->Kill(SIGTERM);
+  m_process.reset();
+}
+
+bool SlurpPicker::Poll(int* out) {
+  if (!Running())
+    return false;
+
+  // Still running.
+  if (m_process->ReadAvailable(m_output)) {
+    if (std::chrono::steady_clock::now() - m_start > std::chrono::duration<float>(TIMEOUT)) {
+      Cancel();
+      m_error = "Selection timed out.";
+    }
+    return false;
+  }
+
+  // EOF, slurp exited.
+  m_process->Wait(m_output);
+  m_process.reset();
+
+  if (m_output.find("cancelled") != std::string::npos) {
+    m_error = "Selection cancelled.";
+    return false;
+  }
+
+  std::istringstream is(m_output);
+  int region[4];
+  for (int i = 0; i < 4; i++) {
+    if (!(is >> region[i])) {
+      m_error = "Unexpected output of slurp: " + m_output;
+      return false;
+    }
+  }
+  std::copy(region, region + 4, out);
+  return true;
+}
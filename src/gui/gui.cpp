@@ -17,14 +17,12 @@ void gui::help_marker(const char* desc) {
   }
 }
 
-bool gui::device_getter(void* data, int n, const char** str) {
-  auto devices = (std::vector<Device>*)data;
-  *str = (*devices)[n].name.c_str();
-  return true;
-}
-
 bool gui::senum_getter(void* data, int n, const char** str) {
-  auto e = (SEnum*)data;
-  *str = e->get(n).c_str();
+  // Called for every visible item each frame, so out of range items are
+  // skipped instead of going through the throwing SEnum::get().
+  auto e = (const SEnum*)data;
+  if (n < 0 || n >= (int)e->options.size())
+    return false;
+  *str = e->options[n].c_str();
   return true;
 }
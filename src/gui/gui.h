@@ -5,13 +5,23 @@
  */
 #pragma once
 #include "../device_manager.h"
+#include "../device_index.h"
+#include "../input_stats.h"
 #include "../config.h"
+#include "../event_loop.h"
+#include "../managed_config.h"
+#include "../perf.h"
+#include "../process.h"
+#include "../xkb_catalogue.h"
+#include <chrono>
+#include <functional>
+#include <future>
 #include <imgui_internal.h>
 #include <imgui.h>
 
 /// Combo button created from SEnum (selectable string enum)
 #define IMGUI_COMBO_SENUM(label, senum)                                        \
-  ImGui::Combo(label, &senum.sel, &gui::senum_getter, &senum.options,          \
+  ImGui::Combo(label, &senum.sel, &gui::senum_getter, &senum,                  \
                senum.options.size())
 
 /// Help marker on the same line or below
@@ -26,8 +36,6 @@ namespace gui {
    * @param desc Text to show as help
    */
   void help_marker(const char* desc);
-  /// ImGui::Combo getter callback for use with std::vector<Device>.
-  bool device_getter(void* data, int n, const char** str);
   /// ImGui::Combo getter callback for use with SEnum.
   bool senum_getter(void* data, int n, const char** str);
   /**
@@ -45,6 +53,138 @@ namespace gui {
     ImGui::EndDisabled();
   }
 
+  /**
+   * @brief Runs slurp as a child process without blocking the frame loop.
+   *
+   * Output of slurp is read from non-blocking pipe by calling Poll() every
+   * frame.
+   */
+  class SlurpPicker {
+  public:
+    /// Number of seconds after which the selection is cancelled.
+    static constexpr float TIMEOUT = 60.0f;
+
+    ~SlurpPicker();
+
+    /// Start slurp. Returns FALSE if it is already running or failed to start.
+    bool Start();
+    /// Kill running slurp.
+    void Cancel();
+    /**
+     * @brief Read output of running slurp.
+     * @param out Where to write the selected region (x, y, w, h).
+     * @return TRUE once slurp exited with valid region.
+     */
+    bool Poll(int* out);
+    inline bool Running() const { return m_process.has_value(); }
+    /// Reason of the last failure. Empty if none.
+    inline const std::string& Error() const { return m_error; }
+
+  private:
+    std::optional<Process> m_process;
+    std::string m_output;
+    std::string m_error;
+    std::chrono::steady_clock::time_point m_start;
+  };
+
+  /**
+   * @brief Test pad measuring key repeat as applications receive it.
+   *
+   * Key events are recorded by a GLFW key callback (chained with the one of
+   * ImGui), installed when the test is started for the first time. Every
+   * key press starts a new measurement.
+   */
+  class KeyRepeatAnalyzer {
+  public:
+    /// Number of repeat intervals kept.
+    static constexpr size_t HISTORY = 256;
+
+    ~KeyRepeatAnalyzer();
+
+    /**
+     * @brief Draw the test controls and measured values.
+     * @param delay Configured repeat delay in milliseconds.
+     * @param rate Configured repeat rate in characters per second.
+     */
+    void OnUpdate(int delay, int rate);
+    /// Record key event. `time` is in seconds.
+    void OnKey(int key, int action, double time);
+
+  private:
+    bool m_capturing = false;
+    int m_key = -1;         ///< Key being held
+    double m_pressTime = 0.0;
+    double m_lastTime = 0.0;
+    float m_delay = 0.0f;   ///< Measured delay in ms, 0 before first repeat
+    input::Ring<float, HISTORY> m_intervals; ///< Repeat intervals in ms
+    bool m_dirty = false;   ///< m_intervals changed since last summary
+    std::array<float, HISTORY> m_plot{};
+    input::Summary m_summary;
+    std::string m_error;
+  };
+
+  /**
+   * @brief Measures pointer event rate and the effect of acceleration.
+   *
+   * Cursor motion and scroll events are recorded by chained GLFW callbacks
+   * into fixed size ring buffers, so recording stays cheap at 1000 Hz.
+   * Events are timestamped when GLFW dispatches them, in batches once per
+   * frame, so only the mean event rate describes the device. Single
+   * intervals show frame pacing.
+   * Motion is split into strokes by pauses. For strokes of the same physical
+   * length, displacement doesn't depend on velocity with flat acceleration
+   * and grows with it with adaptive one.
+   */
+  class PointerAnalyzer {
+  public:
+    /// Number of motion intervals kept.
+    static constexpr size_t HISTORY = 2048;
+    /// Number of strokes kept.
+    static constexpr size_t STROKES = 128;
+    /// Pause (seconds) ending a stroke. Longer intervals don't count into the rate.
+    static constexpr double STROKE_GAP = 0.05;
+    static constexpr float PLOT_HEIGHT = 150.0f;
+
+    ~PointerAnalyzer();
+
+    /// Draw the test controls and measured values.
+    void OnUpdate();
+    /// Keep strokes measured so far as reference (e.g. before Apply).
+    void Snapshot();
+    /// Record cursor position. `time` is in seconds.
+    void OnMotion(double x, double y, double time);
+    /// Record scroll offset. `time` is in seconds.
+    void OnScroll(double dx, double dy, double time);
+
+  private:
+    /// Stroke summary, one point of the plot.
+    struct Stroke {
+      float velocity;     ///< Mean velocity in px/s
+      float displacement; ///< Travelled distance in px
+    };
+
+    bool m_capturing = false;
+    input::Ring<float, HISTORY> m_intervals; ///< Motion intervals in ms
+    input::Ring<Stroke, STROKES> m_strokes;
+    input::Ring<Stroke, STROKES> m_reference;
+    // Stroke in progress.
+    double m_strokeStart = 0.0, m_lastTime = -1.0;
+    double m_lastX = 0.0, m_lastY = 0.0;
+    double m_distance = 0.0;
+    // Scrolling.
+    uint64_t m_scrollEvents = 0;
+    double m_scrollSum = 0.0;
+    bool m_dirty = false; ///< m_intervals changed since last summary
+    std::array<float, HISTORY> m_plot{};
+    input::Summary m_summary;
+    std::string m_error;
+
+    /// Finish stroke in progress.
+    void endStroke();
+    /// Velocity/displacement plot of current and reference strokes.
+    void guiStrokes();
+  };
+
   /// Base class for GUI elements.
   class Gui {
   public:
@@ -54,39 +194,129 @@ namespace gui {
   /// Editor for device properties.
   class DeviceEditor : public Gui {
     const float MAX_SCROLL_FACTOR = 5.0f;
+    const float REGION_PICKER_HEIGHT = 200.0f;
   public:
+    /// Tabs with device options.
+    enum class Tab { keyboard, tablet, mapping, libinput };
+
     /**
      * @brief Construct new instance of DeviceEditor
      * @param manager Device manager to use for editing device properties.
      * @param config Program configuration
+     * @param event_loop Event loop to schedule redraws with.
      */
-    DeviceEditor(DeviceMan& manager, Configuration& config);
+    DeviceEditor(DeviceMan& manager, Configuration& config, EventLoop& event_loop);
 
     /// Construct and update all GUI components.
     void OnUpdate(float dt) override;
 
+    /**
+     * @brief Select device and optionally the options tab to show in next frame.
+     * @param device Index of the device in DeviceMan.
+     * @param tab Tab to open. Ignored if the device doesn't have it.
+     */
+    void Select(int device, std::optional<Tab> tab = {});
+    /// Open or close the "Sway config" node in next frame.
+    inline void ShowSwayConfig(bool show) { m_showSwayConfig = show; }
+
   private:
     DeviceMan& m_manager;
     Device* m_device{ nullptr };
     Configuration& m_config;
+    EventLoop& m_eventLoop;
+    // Devices are tracked by sway_id, their indices change on unplug. The
+    // indices are resolved every frame.
+    int m_selDevice = 0;
+    std::string m_selId;       ///< sway_id of the selected device
+    int m_revertDevice = 0;
+    std::string m_revertId;    ///< sway_id of the device with changes pending revert
+    float m_revertTime = 0.0f; ///< Seconds since the changes were applied
+    std::optional<Tab> m_selTab;
+    std::optional<bool> m_showSwayConfig;
+    SlurpPicker m_slurp;
+    std::string m_slurpDevice; ///< sway_id of the device selecting region
+    std::optional<ImVec2> m_regionDrag; ///< Drag start in layout coordinates
+    ManagedConfig m_managedConfig;
+    std::string m_managedStatus; ///< Result of the last save to m_managedConfig or presets
+    std::string m_swayError;     ///< Failure of the last apply or revert
+    DeviceIndex m_deviceIndex;
+    char m_deviceQuery[64] = "";
+    std::future<xkb::Catalogue> m_xkbLoading; ///< Catalogue loaded in background
+    std::optional<xkb::Catalogue> m_xkb;
+    std::string m_xkbError;
+    char m_layoutQuery[64] = "";
+    char m_optionQuery[64] = "";
+    std::vector<uint32_t> m_layoutResults; ///< Layouts matching m_layoutQuery
+    std::vector<uint32_t> m_optionResults; ///< Options matching m_optionQuery
+    KeyRepeatAnalyzer m_keyRepeat;
+    PointerAnalyzer m_pointerTest;
+    // Buffers reused every frame, so idle frames don't allocate.
+    std::string m_swayConfig;    ///< Text of the "Sway config" node
+    std::string m_saveHint;      ///< Hint of the save buttons
+    std::string m_rejectedNames; ///< Settings sway rejected for the selected device
+    std::vector<std::string> m_layoutItems;  ///< Split xkb_layout
+    std::vector<std::string> m_variantItems; ///< Split xkb_variant
+    std::vector<std::string> m_optionItems;  ///< Split xkb_options
+
+    /// Tab item flags selecting the tab if requested by Select().
+    int tabFlags(Tab tab) const;
 
+    /// Device selector with search over all devices.
+    void guiDeviceSelector();
     void guiKeyboard();
+    /// Layout, variant and option pickers backed by the xkb catalogue.
+    void guiXkb();
     void guiTablet();
     void guiMapping();
+    /// Output layout on which region can be selected by dragging.
+    void guiRegionPicker();
     void guiLibInput();
     void guiOptions();
     void guiSwayConfig(int selected_device);
-    void guiRevertPopup(float dt, int selected_device, float& current_timeout);
-    bool callSlurp(int* out);
+    void guiRevertPopup(float dt);
+    /// Index of the device with given sway_id, preferring `hint`. -1 if it is gone.
+    int findDevice(const std::string& sway_id, int hint) const;
+    /// Send changes to sway, keeping the failure in m_swayError. FALSE on failure.
+    bool trySway(const std::function<void()>& send);
+    /// Write region selected by slurp into the device which started it.
+    void pollSlurp();
   };
 
   /// TODO: Application settings.
   // class Settings : public Gui {};
 
+  /// Debug window with frame time, IPC counters and latency histograms.
+  class PerfOverlay : public Gui {
+    /// Number of frame times kept for the frame time plot.
+    static constexpr int FRAME_HISTORY = 120;
+  public:
+    bool m_Visible = false;
+    /// Seconds the previous frame was blocked in EventLoop::Wait().
+    float m_Waited = 0.0f;
+
+    /// Record frame time and draw the window if visible.
+    void OnUpdate(float dt) override;
+
+  private:
+    std::array<float, FRAME_HISTORY> m_frameTimes{};
+    int m_frameOffset = 0;
+
+    void guiHistogram(const char* label, const perf::Histogram& hist);
+  };
+
   /// TODO: The application main bar.
   class MenuBar : public Gui {
   public:
+    /**
+     * @brief Construct new instance of MenuBar
+     * @param perf_overlay Performance overlay toggled from the View menu.
+     */
+    MenuBar(PerfOverlay& perf_overlay);
+
     void OnUpdate(float dt) override;
+
+  private:
+    PerfOverlay& m_perfOverlay;
   };
 
 }; // gui
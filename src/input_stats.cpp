@@ -0,0 +1,29 @@
+/**
+ * @brief Implementation of input statistics
+ * @file input_stats.cpp
+ */
+#include "input_stats.h"
+#include <algorithm>
+#include <cmath>
+
+input::Summary input::summarize(std::span<float> values) {
+  Summary sum;
+  sum.count = values.size();
+  if (values.empty())
+    return sum;
+
+  std::sort(values.begin(), values.end());
+  for (float v : values)
+    sum.mean += v;
+  sum.mean /= values.size();
+  for (float v : values)
+    sum.jitter += (v - sum.mean) * (v - sum.mean);
+  sum.jitter = std::sqrt(sum.jitter / values.size());
+
+  auto pct = [&](double p) { return values[std::min(values.size() - 1, size_t(p * values.size()))]; };
+  sum.p50 = pct(0.50);
+  sum.p99 = pct(0.99);
+  sum.min = values.front();
+  sum.max = values.back();
+  return sum;
+}
@@ -0,0 +1,51 @@
+/**
+ * @brief Statistics of timed input events used by the input analyzers.
+ * @file input_stats.h
+ *
+ * Samples are kept in fixed size ring buffers, so recording events from
+ * GLFW callbacks never allocates, even at 1000 Hz mouse rates.
+ */
+#pragma once
+#include <array>
+#include <cstddef>
+#include <span>
+
+namespace input {
+  /// Fixed size ring buffer overwriting the oldest samples when full.
+  template <typename T, size_t N> class Ring {
+  public:
+    void Push(const T& value) {
+      m_data[(m_start + m_size) % N] = value;
+      if (m_size < N)
+        m_size++;
+      else
+        m_start = (m_start + 1) % N;
+    }
+    inline void Clear() { m_start = m_size = 0; }
+    inline size_t Size() const { return m_size; }
+    inline bool Empty() const { return m_size == 0; }
+    static constexpr size_t Capacity() { return N; }
+    /// Sample `i`, 0 is the oldest one.
+    inline const T& operator[](size_t i) const { return m_data[(m_start + i) % N]; }
+    inline const T& Back() const { return (*this)[m_size - 1]; }
+
+  private:
+    std::array<T, N> m_data{};
+    size_t m_start = 0;
+    size_t m_size = 0;
+  };
+
+  /// Summary of a distribution of values.
+  struct Summary {
+    size_t count = 0;
+    double mean = 0.0;
+    double jitter = 0.0; ///< Standard deviation
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+  };
+
+  /// Summarize values. The values are sorted in place.
+  Summary summarize(std::span<float> values);
+}
@@ -0,0 +1,207 @@
+/**
+ * @brief Implementation of IPC session recording and replay
+ * @file ipc_record.cpp
+ */
+#include "ipc_record.h"
+#include <algorithm>
+#include <stdexcept>
+
+#include <poll.h>
+
+using namespace ipc;
+
+namespace {
+  constexpr std::string_view FILE_MAGIC = "SWICREC";
+  constexpr uint8_t FILE_VERSION = 1;
+
+  template <typename T> void put(std::ostream& os, T val) {
+    for (size_t i = 0; i < sizeof(T); i++)
+      os.put(char((val >> (8 * i)) & 0xff));
+  }
+
+  template <typename T> bool get(std::istream& is, T& out) {
+    out = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      int c = is.get();
+      if (c == EOF)
+        return false;
+      out |= T(uint8_t(c)) << (8 * i);
+    }
+    return true;
+  }
+
+  void put_str(std::ostream& os, const std::string& str) {
+    put<uint32_t>(os, str.size());
+    os.write(str.data(), str.size());
+  }
+
+  bool get_str(std::istream& is, std::string& out) {
+    uint32_t len;
+    if (!get(is, len))
+      return false;
+    out.resize(len);
+    return bool(is.read(out.data(), len));
+  }
+}
+
+std::vector<Record> ipc::load_records(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    throw std::runtime_error("Failed to open recording " + path);
+
+  std::string magic(FILE_MAGIC.size(), '\0');
+  file.read(magic.data(), magic.size());
+  if (magic != FILE_MAGIC || file.get() != FILE_VERSION)
+    throw std::runtime_error("Invalid or unsupported recording " + path);
+
+  std::vector<Record> records;
+  uint8_t kind;
+  while (get(file, kind)) {
+    Record rec;
+    rec.kind = Record::Kind(kind);
+    if (!get(file, rec.type) || !get(file, rec.time_us) || !get_str(file, rec.payload) ||
+        (rec.kind == Record::request && !get_str(file, rec.reply)))
+      throw std::runtime_error("Truncated recording " + path);
+    records.push_back(std::move(rec));
+  }
+  return records;
+}
+
+Recorder::Recorder(std::unique_ptr<Transport> inner, const std::string& path)
+  : m_inner(std::move(inner))
+  , m_file(path, std::ios::binary | std::ios::trunc)
+  , m_start(std::chrono::steady_clock::now())
+{
+  if (!m_file.is_open())
+    throw std::runtime_error("Failed to create recording " + path);
+  m_file.write(FILE_MAGIC.data(), FILE_MAGIC.size());
+  m_file.put(FILE_VERSION);
+}
+
+void Recorder::write(const Record& rec) {
+  std::lock_guard lock(m_mutex);
+  put<uint8_t>(m_file, rec.kind);
+  put(m_file, rec.type);
+  put(m_file, rec.time_us);
+  put_str(m_file, rec.payload);
+  if (rec.kind == Record::request)
+    put_str(m_file, rec.reply);
+  // Flush so that the recording survives a crash.
+  m_file.flush();
+}
+
+std::string Recorder::Request(MsgType type, const std::string& payload) {
+  auto time = std::chrono::steady_clock::now() - m_start;
+  std::string reply = m_inner->Request(type, payload);
+  write({Record::request, uint32_t(type),
+         uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(time).count()),
+         payload, reply});
+  return reply;
+}
+
+Transport::Ticket Recorder::Submit(MsgType type, const std::string& payload) {
+  auto time = std::chrono::steady_clock::now() - m_start;
+  Ticket ticket = m_inner->Submit(type, payload);
+  m_submitted[ticket] = {Record::request, uint32_t(type),
+                         uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(time).count()),
+                         payload, ""};
+  return ticket;
+}
+
+std::string Recorder::Wait(Ticket ticket) {
+  std::string reply = m_inner->Wait(ticket);
+  auto it = m_submitted.find(ticket);
+  if (it != m_submitted.end()) {
+    it->second.reply = reply;
+    write(it->second);
+    m_submitted.erase(it);
+  }
+  return reply;
+}
+
+bool Recorder::Ready(Ticket ticket) {
+  return m_inner->Ready(ticket);
+}
+
+bool Recorder::Subscribe(const std::string& events) {
+  return m_inner->Subscribe(events);
+}
+
+std::optional<Message> Recorder::NextEvent(int stop_fd) {
+  auto msg = m_inner->NextEvent(stop_fd);
+  if (msg) {
+    auto time = std::chrono::steady_clock::now() - m_start;
+    write({Record::event, msg->type,
+           uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(time).count()),
+           msg->payload, ""});
+  }
+  return msg;
+}
+
+void Recorder::SetTimeout(std::chrono::milliseconds timeout) {
+  Transport::SetTimeout(timeout);
+  m_inner->SetTimeout(timeout);
+}
+
+ReplayTransport::ReplayTransport(const std::string& path)
+  : m_start(std::chrono::steady_clock::now())
+{
+  for (auto& rec : load_records(path)) {
+    if (rec.kind == Record::event)
+      m_events.push_back(std::move(rec));
+    else
+      m_requests.push_back(std::move(rec));
+  }
+  m_used.resize(m_requests.size(), false);
+}
+
+std::string ReplayTransport::Request(MsgType type, const std::string& payload) {
+  std::lock_guard lock(m_mutex);
+  const Record* last = nullptr;
+  for (size_t i = 0; i < m_requests.size(); i++) {
+    if (m_requests[i].type != uint32_t(type))
+      continue;
+    last = &m_requests[i];
+    if (m_used[i])
+      continue;
+    m_used[i] = true;
+    if (m_requests[i].payload != payload)
+      m_mismatches++;
+    return m_requests[i].reply;
+  }
+
+  if (!last)
+    throw std::runtime_error("No recorded reply for " + std::string(GetMsgTypeName(type)));
+  if (last->payload != payload)
+    m_mismatches++;
+  return last->reply;
+}
+
+bool ReplayTransport::Subscribe(const std::string&) {
+  return !m_events.empty();
+}
+
+std::optional<Message> ReplayTransport::NextEvent(int stop_fd) {
+  using namespace std::chrono;
+  // Nothing but stopping is left to wait for after the last event.
+  int timeout_ms = -1;
+  const Record* rec = nullptr;
+  {
+    std::lock_guard lock(m_mutex);
+    if (m_nextEvent < m_events.size()) {
+      rec = &m_events[m_nextEvent];
+      timeout_ms = 0;
+      if (m_Speed > 0.0f) {
+        auto due = m_start + duration_cast<steady_clock::duration>(microseconds(rec->time_us) / m_Speed);
+        timeout_ms = std::max<int64_t>(0, ceil<milliseconds>(due - steady_clock::now()).count());
+      }
+    }
+  }
+
+  pollfd pfd = {stop_fd, POLLIN, 0};
+  if (poll(&pfd, 1, timeout_ms) != 0 || !rec)
+    return {};
+  std::lock_guard lock(m_mutex);
+  m_nextEvent++;
+  return Message{rec->type, rec->payload};
+}
@@ -0,0 +1,96 @@
+/**
+ * @brief Recording and replaying of sway IPC sessions.
+ * @file ipc_record.h
+ *
+ * Session file format (all integers little endian):
+ *
+ *   "SWICREC" u8(version)
+ *   records... where record is:
+ *     u8(kind) u32(type) u64(time_us) u32(len) payload [u32(len) reply]
+ *
+ * `kind` is 0 for request (followed by its reply) and 1 for event.
+ * `time_us` is the time since the start of the recording.
+ */
+#pragma once
+#include "sway_ipc.h"
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ipc {
+  /// One recorded request or event.
+  struct Record {
+    enum Kind : uint8_t { request = 0, event = 1 };
+    Kind kind;
+    uint32_t type;
+    uint64_t time_us;
+    std::string payload;
+    std::string reply; ///< Empty for events
+  };
+
+  /// Load all records from a session file.
+  std::vector<Record> load_records(const std::string& path);
+
+  /// Transport recording all traffic of another transport into a file.
+  class Recorder : public Transport {
+  public:
+    /**
+     * @param inner Transport to record.
+     * @param path Path of the session file to create.
+     * @exception std::runtime_error When the file cannot be created.
+     */
+    Recorder(std::unique_ptr<Transport> inner, const std::string& path);
+
+    std::string Request(MsgType type, const std::string& payload) override;
+    Ticket Submit(MsgType type, const std::string& payload) override;
+    std::string Wait(Ticket ticket) override;
+    bool Ready(Ticket ticket) override;
+    bool Subscribe(const std::string& events) override;
+    std::optional<Message> NextEvent(int stop_fd) override;
+    void SetTimeout(std::chrono::milliseconds timeout) override;
+
+  private:
+    std::unique_ptr<Transport> m_inner;
+    /// Submitted requests, written once their reply is taken.
+    std::unordered_map<Ticket, Record> m_submitted;
+    std::ofstream m_file;
+    std::mutex m_mutex; ///< Events may be read from other thread.
+    std::chrono::steady_clock::time_point m_start;
+
+    void write(const Record& rec);
+  };
+
+  /**
+   * @brief Transport replaying recorded session without sway.
+   *
+   * Requests are answered by the next recorded request of the same type.
+   * When the recording runs out, the last reply of that type is repeated.
+   * Events are delivered at their recorded times relative to the creation
+   * of the transport, scaled by m_Speed (0 delivers them immediately).
+   */
+  class ReplayTransport : public Transport {
+  public:
+    float m_Speed = 1.0f;
+
+    /// @exception std::runtime_error When the file cannot be read.
+    ReplayTransport(const std::string& path);
+
+    std::string Request(MsgType type, const std::string& payload) override;
+    bool Subscribe(const std::string& events) override;
+    std::optional<Message> NextEvent(int stop_fd) override;
+
+    /// Number of requests whose payload differed from the recording.
+    inline int Mismatches() const { return m_mismatches; }
+
+  private:
+    std::vector<Record> m_requests;
+    std::vector<Record> m_events;
+    std::vector<bool> m_used;
+    size_t m_nextEvent = 0;
+    int m_mismatches = 0;
+    std::mutex m_mutex;
+    std::chrono::steady_clock::time_point m_start;
+  };
+}
@@ -1,39 +1,153 @@
 /**
  * @file main.cpp
  */
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <cstdio> // popen
 #include <iostream>
+#include <optional>
 #include <sstream> // std::istringstream
 #include <string>
 #include <vector>
 
 #include "device_manager.h"
+#include "capability_cache.h"
 #include "config.h"
+#include "daemon.h"
+#include "ipc_record.h"
+#include "perf.h"
+#include "preset_library.h"
+#include "single_instance.h"
 #include "gui/gui.h"
 #include <imgui_internal.h>
 #include <imguiwrapper.hpp>
+#include <unistd.h> // getpid
+
+// Deadline of requests to sway from configuration in seconds.
+static std::chrono::milliseconds ipc_timeout(const AppConfiguration& config) {
+  return std::chrono::milliseconds(int64_t(config.ipc_timeout * 1000.0f));
+}
 
 class App {
+  EventLoop m_eventLoop;
   DeviceMan m_devMan;
-  Configuration m_config;
+  Configuration& m_config;
+  ConfigWatcher m_configWatcher;
+  bool m_reconnect;
+  SingleInstance* m_instance;
   gui::DeviceEditor m_deviceEditor;
+  gui::PerfOverlay m_perfOverlay;
   gui::MenuBar m_menuBar;
   // gui::Settings m_settings;
 
 public:
-  App(Configuration& config)
-    : m_devMan(config.app.swaymsg_path)
+  /**
+   * @param reconnect Connect to sway again when its connection options
+   *                  change (not when recording or replaying a session).
+   * @param instance Lock of the first instance receiving arguments of later
+   *                 ones, nullptr if instances run on their own.
+   */
+  App(Configuration& config, std::unique_ptr<ipc::Transport> transport, bool reconnect,
+      SingleInstance* instance)
+    : m_devMan(std::move(transport))
     , m_config(config)
-    , m_deviceEditor(m_devMan, m_config)
+    , m_configWatcher([this]() { m_eventLoop.Wake(); })
+    , m_reconnect(reconnect)
+    , m_instance(instance)
+    , m_deviceEditor(m_devMan, m_config, m_eventLoop)
+    , m_menuBar(m_perfOverlay)
   {
     if (m_devMan.m_Devices.size() == 0)
       throw std::runtime_error("No devices found.");
+    if (m_config.app.import_sway_config)
+      m_devMan.ImportSwayConfig(m_config.app.sway_config);
+    if (m_config.app.capability_cache)
+      m_devMan.LoadCapabilities(CapabilityCache::DefaultPath());
+    try {
+      m_devMan.LoadPresets(m_config.app.preset_library.empty() ? PresetLibrary::DefaultPath()
+                                                               : m_config.app.preset_library);
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+    }
+    m_eventLoop.m_Enabled = m_config.app.idle_rendering;
+    m_devMan.StartEvents([this]() { m_eventLoop.Wake(); });
+    if (m_instance)
+      m_instance->Listen([this]() { m_eventLoop.Wake(); });
   }
 
   void OnUpdate(float dt) {
-    m_menuBar.OnUpdate(dt);
-    m_deviceEditor.OnUpdate(dt);
-    // m_settings.OnUpdate(dt);
+    // Idle frames must not allocate, see bench_gui.
+    uint64_t allocs = perf::thread_allocs();
+    if (auto config = m_configWatcher.Poll())
+      reloadConfig(*config);
+    m_devMan.ProcessEvents();
+    if (m_instance)
+      for (auto& args : m_instance->Poll())
+        handleArgs(args);
+    {
+      perf::AllocScope scope(perf::Subsystem::gui);
+      m_menuBar.OnUpdate(dt);
+      {
+        perf::ScopedTimer timer(perf::stats().editor, perf::Clock::thread);
+        m_deviceEditor.OnUpdate(dt);
+      }
+      m_perfOverlay.OnUpdate(dt);
+      // m_settings.OnUpdate(dt);
+    }
+    perf::stats().frame_allocs.Record(perf::thread_allocs() - allocs);
+
+    // Block until there is something new to draw.
+    m_perfOverlay.m_Waited = m_eventLoop.Wait();
+  }
+
+  /// Select device by its sway identifier.
+  void SelectDevice(const std::string& sway_id) {
+    for (size_t i = 0; i < m_devMan.m_Devices.size(); i++) {
+      if (m_devMan.m_Devices[i].sway_id == sway_id) {
+        m_deviceEditor.Select(i);
+        return;
+      }
+    }
+    std::cerr << "No device " << sway_id << std::endl;
+  }
+
+private:
+  // Arguments of a later instance. Only `--device` matters to a running one.
+  void handleArgs(const std::vector<std::string>& args) {
+    for (size_t i = 0; i + 1 < args.size(); i++)
+      if (args[i] == "--device")
+        SelectDevice(args[++i]);
+    raise();
+  }
+
+  // Bring the window to front. Wayland clients can't take focus, so sway is
+  // asked to focus it.
+  void raise() {
+    m_eventLoop.Wake();
+    if (!m_reconnect)
+      return;
+    try {
+      auto transport = ipc::connect(m_config.app.swaymsg_path, m_config.app.native_ipc);
+      transport->SetTimeout(ipc_timeout(m_config.app));
+      transport->Request(ipc::MsgType::run_command, "[pid=" + std::to_string(getpid()) + "] focus");
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+
+  // Apply configuration edited while running. Options used only at startup
+  // (window, sway config import, caches) take effect on next start. All of
+  // it is adopted, so that saving on exit doesn't overwrite the edit.
+  void reloadConfig(const Configuration& config) {
+    const AppConfiguration& app = config.app;
+    bool reconnect = app.swaymsg_path != m_config.app.swaymsg_path ||
+                     app.native_ipc != m_config.app.native_ipc;
+    m_config = config;
+    m_eventLoop.m_Enabled = app.idle_rendering;
+    if (reconnect && m_reconnect)
+      m_devMan.SetTransport(ipc::connect(app.swaymsg_path, app.native_ipc));
+    m_devMan.SetTimeout(ipc_timeout(app));
   }
 };
 
@@ -52,12 +166,126 @@ Configuration get_default_config() {
   app.safe_mode = true;
   app.swaymsg_path = "swaymsg";
   app.revert_timeout = 10.0f;
+  app.native_ipc = true;
+  app.idle_rendering = true;
 
   return { imwrap, app };
 }
 
-int main() {
+/// Command line arguments.
+struct Args {
+  std::string record; ///< Record the sway IPC session into this file
+  std::string replay; ///< Replay recorded sway IPC session instead of using sway
+  std::string library; ///< Build preset library into this file and exit
+  std::vector<std::string> preset_configs; ///< Sway configs with presets for `library`
+  bool daemon = false; ///< Run in background without GUI, sharing device state
+  std::string device;  ///< sway_id of the device to select
+};
+
+Args parse_args(int argc, char** argv) {
+  Args args;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if ((arg == "--record" || arg == "--replay") && i + 1 < argc) {
+      (arg == "--record" ? args.record : args.replay) = argv[++i];
+    } else if (arg == "--device" && i + 1 < argc) {
+      args.device = argv[++i];
+    } else if (arg == "--daemon") {
+      args.daemon = true;
+    } else if (arg == "--build-presets" && i + 2 < argc) {
+      args.library = argv[++i];
+      while (i + 1 < argc)
+        args.preset_configs.push_back(argv[++i]);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--device <identifier>] [--record <file>] [--replay <file>]\n"
+                << "       " << argv[0] << " --daemon\n"
+                << "       " << argv[0] << " --build-presets <library> <sway config>..." << std::endl;
+      std::exit(1);
+    }
+  }
+  return args;
+}
+
+// Create transport to sway according to arguments and configuration.
+std::unique_ptr<ipc::Transport> create_transport(const Args& args, const AppConfiguration& config) {
+  std::unique_ptr<ipc::Transport> transport;
+  if (!args.replay.empty())
+    transport = std::make_unique<ipc::ReplayTransport>(args.replay);
+  else if (!args.daemon && config.attach_daemon)
+    transport = DaemonTransport::Attach();
+  if (!transport)
+    transport = ipc::connect(config.swaymsg_path, config.native_ipc);
+
+  if (!args.record.empty())
+    transport = std::make_unique<ipc::Recorder>(std::move(transport), args.record);
+  transport->SetTimeout(ipc_timeout(config));
+  return transport;
+}
+
+// Build preset library from input blocks of sway configs.
+int build_presets(const Args& args) {
+  try {
+    std::vector<PresetLibrary::Entry> entries;
+    for (auto& path : args.preset_configs) {
+      auto config = PresetLibrary::FromSwayConfig(path);
+      entries.insert(entries.end(), config.begin(), config.end());
+    }
+    PresetLibrary::Write(args.library, entries);
+    std::cout << PresetLibrary(args.library).Size() << " presets written to " << args.library << std::endl;
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+static std::atomic<Daemon*> g_daemon{nullptr};
+
+static void on_signal(int) {
+  if (Daemon* daemon = g_daemon)
+    daemon->Stop();
+}
+
+// Publish device state and serve attached instances until interrupted.
+int run_daemon(const Args& args, const AppConfiguration& config) {
+  try {
+    Daemon daemon(create_transport(args, config));
+    // Handler must not see the daemon once it is destroyed.
+    g_daemon = &daemon;
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::signal(SIGPIPE, SIG_IGN);
+    try {
+      daemon.Run();
+    } catch (...) {
+      g_daemon = nullptr;
+      throw;
+    }
+    g_daemon = nullptr;
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  Args args = parse_args(argc, argv);
+  if (!args.library.empty())
+    return build_presets(args);
   Configuration config = load_config().value_or(get_default_config());
+  if (args.daemon)
+    return run_daemon(args, config.app);
+
+  // Later launches only hand their arguments to the running editor, before
+  // creating a window or talking to sway. Recording and replaying sessions
+  // always run on their own.
+  std::optional<SingleInstance> instance;
+  if (config.app.single_instance && args.record.empty() && args.replay.empty()) {
+    instance.emplace();
+    if (!instance->Primary() && instance->Forward(std::vector<std::string>(argv + 1, argv + argc)))
+      return 0;
+  }
 
   try {
     auto context = ImWrap::Context::Create(config.imwrap);
@@ -67,7 +295,10 @@ int main() {
     imgui_io.IniFilename = nullptr;
     imgui_io.LogFilename = nullptr;
 
-    App app(config);
+    App app(config, create_transport(args, config.app), args.record.empty() && args.replay.empty(),
+            instance && instance->Primary() ? &instance.value() : nullptr);
+    if (!args.device.empty())
+      app.SelectDevice(args.device);
     ImWrap::run(context, app);
     ImWrap::Context::Destroy(context);
   } catch (const std::runtime_error& e) {
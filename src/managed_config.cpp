@@ -0,0 +1,186 @@
+/**
+ * @brief Implementation of ManagedConfig
+ * @file managed_config.cpp
+ */
+#include "managed_config.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  constexpr std::string_view BEGIN_MARKER = "# swic begin ";
+  constexpr std::string_view END_MARKER = "# swic end ";
+  constexpr std::string_view HEADER =
+      "# Input settings managed by swic. Blocks between \"# swic\" markers are\n"
+      "# rewritten by swic, anything outside of them is kept.\n";
+
+  /// Part of the file, either managed block (with markers) or other text.
+  struct Segment {
+    std::string identifier; ///< Empty for text outside of markers
+    std::string text;
+  };
+
+  std::vector<Segment> split(const std::string& content) {
+    std::vector<Segment> segments;
+    std::istringstream is(content);
+    std::string line;
+    Segment* block = nullptr;
+    while (std::getline(is, line)) {
+      if (!is.eof())
+        line += '\n';
+      if (!block && line.starts_with(BEGIN_MARKER)) {
+        std::string id = line.substr(BEGIN_MARKER.size());
+        while (!id.empty() && std::isspace((unsigned char)id.back()))
+          id.pop_back();
+        segments.push_back({id, line});
+        block = &segments.back();
+        continue;
+      }
+      if (block) {
+        block->text += line;
+        if (line.starts_with(END_MARKER))
+          block = nullptr;
+        continue;
+      }
+      if (segments.empty() || !segments.back().identifier.empty())
+        segments.push_back({"", ""});
+      segments.back().text += line;
+    }
+    return segments;
+  }
+
+  std::string marked(const std::string& identifier, const std::string& block) {
+    return std::string(BEGIN_MARKER) + identifier + "\n" + block + std::string(END_MARKER) +
+           identifier + "\n";
+  }
+
+  // Replace file by writing temporary file and renaming it over.
+  void write_atomic(const std::string& path, const std::string& content) {
+    // Symlinked config (e.g. into a dotfiles repository) stays a symlink,
+    // the file it points to is replaced.
+    std::string target = path;
+    if (char* real = realpath(path.c_str(), nullptr)) {
+      target = real;
+      std::free(real);
+    }
+    std::filesystem::path dir = std::filesystem::path(target).parent_path();
+    if (dir.empty())
+      dir = ".";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    std::string tmp = target + ".swic-tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+      throw std::runtime_error("Failed to create " + tmp);
+    // New file gets the mode of the one it replaces.
+    struct stat st;
+    if (stat(target.c_str(), &st) == 0)
+      fchmod(fd, st.st_mode & 07777);
+    size_t written = 0;
+    while (written < content.size()) {
+      ssize_t n = write(fd, content.data() + written, content.size() - written);
+      if (n < 0) {
+        close(fd);
+        unlink(tmp.c_str());
+        throw std::runtime_error("Failed to write " + tmp);
+      }
+      written += n;
+    }
+    // Data must reach the disk before rename, otherwise crash could leave
+    // an empty file behind.
+    fsync(fd);
+    close(fd);
+    if (std::rename(tmp.c_str(), target.c_str()) != 0) {
+      unlink(tmp.c_str());
+      throw std::runtime_error("Failed to replace " + target);
+    }
+    // And so must the rename itself, or the old file may come back.
+    int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+      fsync(dir_fd);
+      close(dir_fd);
+    }
+  }
+}
+
+ManagedConfig::ManagedConfig(std::string path) : m_path(std::move(path)) {}
+
+std::string ManagedConfig::DefaultPath() {
+  std::filesystem::path dir;
+  if (const char* config = std::getenv("XDG_CONFIG_HOME"))
+    dir = config;
+  else if (const char* home = std::getenv("HOME"))
+    dir = std::filesystem::path(home) / ".config";
+  return (dir / "sway" / "config.d" / "swic.conf").string();
+}
+
+void ManagedConfig::Set(const std::string& identifier, std::string block) {
+  if (!block.empty() && block.back() != '\n')
+    block += '\n';
+  m_pending[identifier] = std::move(block);
+}
+
+void ManagedConfig::Remove(const std::string& identifier) {
+  m_pending[identifier] = std::nullopt;
+}
+
+int ManagedConfig::Save() {
+  if (m_pending.empty())
+    return 0;
+
+  std::string content;
+  {
+    std::ifstream file(m_path, std::ios::binary);
+    if (file.is_open()) {
+      std::stringstream ss;
+      ss << file.rdbuf();
+      content = ss.str();
+    }
+  }
+  if (content.empty())
+    content = HEADER;
+
+  std::vector<Segment> segments = split(content);
+  int changed = 0;
+  for (auto& [identifier, block] : m_pending) {
+    auto it = std::find_if(segments.begin(), segments.end(),
+                           [&](const Segment& s) { return s.identifier == identifier; });
+    if (!block) {
+      if (it != segments.end()) {
+        segments.erase(it);
+        changed++;
+      }
+      continue;
+    }
+    std::string text = marked(identifier, *block);
+    if (it == segments.end()) {
+      // New blocks are appended after a new line.
+      if (!segments.empty() && !segments.back().text.ends_with('\n'))
+        segments.back().text += '\n';
+      segments.push_back({identifier, text});
+      changed++;
+    } else if (it->text != text) {
+      it->text = text;
+      changed++;
+    }
+  }
+  m_pending.clear();
+  if (changed == 0)
+    return 0;
+
+  std::string out;
+  out.reserve(content.size());
+  for (auto& segment : segments)
+    out += segment.text;
+  write_atomic(m_path, out);
+  return changed;
+}
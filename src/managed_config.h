@@ -0,0 +1,56 @@
+/**
+ * @brief Sway include file with input blocks maintained by swic.
+ * @file managed_config.h
+ *
+ * Every block is enclosed in marker comments:
+ *
+ *     # swic begin <identifier>
+ *     input <identifier> {
+ *         ...
+ *     }
+ *     # swic end <identifier>
+ *
+ * Only blocks whose content changed are replaced, everything else in the
+ * file (other blocks, text added by the user outside of markers) is kept
+ * byte for byte, so the file produces minimal diffs.
+ */
+#pragma once
+#include <map>
+#include <optional>
+#include <string>
+
+class ManagedConfig {
+public:
+  /// @param path File to maintain. Created on first Save() if missing.
+  ManagedConfig(std::string path = DefaultPath());
+
+  /// `$XDG_CONFIG_HOME/sway/config.d/swic.conf` (`~/.config` if not set).
+  static std::string DefaultPath();
+  inline const std::string& Path() const { return m_path; }
+
+  /**
+   * @brief Set content of the block for next Save().
+   * @param identifier Device identifier or `type:<type>`.
+   * @param block Block without markers, trailing new line is added if missing.
+   */
+  void Set(const std::string& identifier, std::string block);
+  /// Remove the block in next Save().
+  void Remove(const std::string& identifier);
+
+  /**
+   * @brief Write pending changes to the file.
+   *
+   * The file is read again first, so that edits made outside of swic are
+   * kept. It is replaced by atomic rename and only if its content changes.
+   * A symlink is followed and the file it points to is replaced, keeping its
+   * mode.
+   * @return Number of blocks which changed.
+   * @exception std::runtime_error When the file can't be written.
+   */
+  int Save();
+
+private:
+  std::string m_path;
+  /// Pending block content by identifier, empty for removal.
+  std::map<std::string, std::optional<std::string>> m_pending;
+};
@@ -0,0 +1,256 @@
+/**
+ * @brief swic-swaymock executable: fake swaymsg and fake $SWAYSOCK server.
+ * @file main.cpp
+ *
+ * Usage:
+ *   swic-swaymock [options] -t <type> [--raw]        Behave like swaymsg
+ *   swic-swaymock [options] <command...>             Run command like swaymsg
+ *   swic-swaymock [options] --serve <socket path>    Serve sway IPC on socket
+ *
+ * Options (each can also be given by environment variable, so that the
+ * executable can be used as `swaymsg_path` without arguments):
+ *   --devices <n>      SWIC_MOCK_DEVICES     Number of generated devices
+ *   --outputs <n>      SWIC_MOCK_OUTPUTS     Number of generated outputs
+ *   --inputs-file <f>  SWIC_MOCK_INPUTS_FILE Canned get_inputs reply
+ *   --outputs-file <f> SWIC_MOCK_OUTPUTS_FILE Canned get_outputs reply
+ *   --latency <ms>     SWIC_MOCK_LATENCY_MS  Delay before every reply
+ *   --log <f>          SWIC_MOCK_LOG         Append received commands to file
+ *   --hotplug <ms>     SWIC_MOCK_HOTPLUG_MS  Unplug/replug the last device
+ *                                            periodically (server only)
+ *   --hotplug-outputs <ms> SWIC_MOCK_HOTPLUG_OUTPUTS_MS Disconnect/connect
+ *                                            the last output periodically
+ *   --reject <names>   SWIC_MOCK_REJECT      Comma separated settings (as in
+ *                                            `input` commands) which fail
+ */
+#include "sway_mock.h"
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct Options {
+  int devices = 4;
+  int outputs = 1;
+  std::string inputs_file;
+  std::string outputs_file;
+  float latency_ms = 0.0f;
+  std::string log;
+  int hotplug_ms = 0;
+  int hotplug_outputs_ms = 0;
+  std::string reject;
+  std::string serve;
+  std::string type = "command";
+  std::string command;
+  bool raw = false;
+};
+
+static volatile std::sig_atomic_t g_running = 1;
+
+static void on_signal(int) { g_running = 0; }
+
+// Read option default from environment variable.
+static std::string env_or(const char* name, const std::string& def) {
+  const char* val = std::getenv(name);
+  return val ? val : def;
+}
+
+static Options parse_options(int argc, char** argv) {
+  Options opt;
+  opt.devices = std::stoi(env_or("SWIC_MOCK_DEVICES", "4"));
+  opt.outputs = std::stoi(env_or("SWIC_MOCK_OUTPUTS", "1"));
+  opt.inputs_file = env_or("SWIC_MOCK_INPUTS_FILE", "");
+  opt.outputs_file = env_or("SWIC_MOCK_OUTPUTS_FILE", "");
+  opt.latency_ms = std::stof(env_or("SWIC_MOCK_LATENCY_MS", "0"));
+  opt.log = env_or("SWIC_MOCK_LOG", "");
+  opt.hotplug_ms = std::stoi(env_or("SWIC_MOCK_HOTPLUG_MS", "0"));
+  opt.hotplug_outputs_ms = std::stoi(env_or("SWIC_MOCK_HOTPLUG_OUTPUTS_MS", "0"));
+  opt.reject = env_or("SWIC_MOCK_REJECT", "");
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc)
+        throw std::runtime_error("Missing value for " + arg);
+      return argv[++i];
+    };
+
+    if (arg == "-t" || arg == "--type")
+      opt.type = next();
+    else if (arg == "-r" || arg == "--raw")
+      opt.raw = true;
+    else if (arg == "-q" || arg == "--quiet")
+      continue;
+    else if (arg == "--devices")
+      opt.devices = std::stoi(next());
+    else if (arg == "--outputs")
+      opt.outputs = std::stoi(next());
+    else if (arg == "--inputs-file")
+      opt.inputs_file = next();
+    else if (arg == "--outputs-file")
+      opt.outputs_file = next();
+    else if (arg == "--latency")
+      opt.latency_ms = std::stof(next());
+    else if (arg == "--log")
+      opt.log = next();
+    else if (arg == "--hotplug")
+      opt.hotplug_ms = std::stoi(next());
+    else if (arg == "--hotplug-outputs")
+      opt.hotplug_outputs_ms = std::stoi(next());
+    else if (arg == "--reject")
+      opt.reject = next();
+    else if (arg == "--serve")
+      opt.serve = next();
+    else if (arg == "--")
+      continue;
+    else
+      opt.command += (opt.command.empty() ? "" : " ") + arg;
+  }
+  return opt;
+}
+
+static mock::json read_json_file(const std::string& path) {
+  std::ifstream stream(path);
+  if (!stream.is_open())
+    throw std::runtime_error("Failed to open " + path);
+  mock::json j;
+  stream >> j;
+  return j;
+}
+
+// Append commands received since `from` to the log file.
+static void flush_log(const Options& opt, const mock::SwayMock& sway, size_t& from) {
+  if (opt.log.empty())
+    return;
+  std::ofstream stream(opt.log, std::ios::app);
+  for (; from < sway.m_Commands.size(); from++)
+    stream << sway.m_Commands[from] << "\n";
+}
+
+// Serve sway IPC on unix socket until interrupted.
+static int serve(const Options& opt, mock::SwayMock& sway) {
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (opt.serve.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path is too long." << std::endl;
+    return 1;
+  }
+  opt.serve.copy(addr.sun_path, opt.serve.size());
+  unlink(opt.serve.c_str());
+  if (listen_fd < 0 || bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(listen_fd, 16) < 0) {
+    std::cerr << "Failed to listen on " << opt.serve << std::endl;
+    return 1;
+  }
+
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+  std::signal(SIGPIPE, SIG_IGN);
+  std::cout << "SWAYSOCK=" << opt.serve << std::endl;
+
+  std::vector<pollfd> fds = {{listen_fd, POLLIN, 0}};
+  std::vector<int> subscribers;
+  size_t logged = 0;
+  auto next_hotplug = std::chrono::steady_clock::now() + std::chrono::milliseconds(opt.hotplug_ms);
+  auto next_output = std::chrono::steady_clock::now() + std::chrono::milliseconds(opt.hotplug_outputs_ms);
+  while (g_running) {
+    if (opt.hotplug_ms > 0 && std::chrono::steady_clock::now() >= next_hotplug) {
+      next_hotplug += std::chrono::milliseconds(opt.hotplug_ms);
+      std::string event = sway.Hotplug();
+      for (int fd : subscribers)
+        ipc::write_message(fd, uint32_t(ipc::EventType::input), event);
+    }
+    if (opt.hotplug_outputs_ms > 0 && std::chrono::steady_clock::now() >= next_output) {
+      next_output += std::chrono::milliseconds(opt.hotplug_outputs_ms);
+      std::string event = sway.HotplugOutput();
+      for (int fd : subscribers)
+        ipc::write_message(fd, uint32_t(ipc::EventType::output), event);
+    }
+
+    int timeout = 200;
+    for (int ms : {opt.hotplug_ms, opt.hotplug_outputs_ms})
+      if (ms > 0)
+        timeout = std::min(timeout, ms);
+    if (poll(fds.data(), fds.size(), timeout) <= 0)
+      continue;
+
+    if (fds[0].revents & POLLIN) {
+      int client = accept(listen_fd, nullptr, nullptr);
+      if (client >= 0)
+        fds.push_back({client, POLLIN, 0});
+    }
+
+    for (size_t i = 1; i < fds.size(); i++) {
+      if (!fds[i].revents)
+        continue;
+      auto msg = ipc::read_message(fds[i].fd);
+      if (msg && msg->type == uint32_t(ipc::MsgType::subscribe))
+        subscribers.push_back(fds[i].fd);
+      if (!msg || !ipc::write_message(fds[i].fd, msg->type,
+                                      sway.Handle(ipc::MsgType(msg->type), msg->payload))) {
+        std::erase(subscribers, fds[i].fd);
+        close(fds[i].fd);
+        fds.erase(fds.begin() + i--);
+      }
+    }
+    flush_log(opt, sway, logged);
+  }
+
+  for (auto& fd : fds)
+    close(fd.fd);
+  unlink(opt.serve.c_str());
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  try {
+    Options opt = parse_options(argc, argv);
+
+    mock::SwayMock sway(opt.devices, opt.outputs);
+    sway.m_Latency = std::chrono::microseconds(int64_t(opt.latency_ms * 1000.0f));
+    std::istringstream reject(opt.reject);
+    for (std::string name; std::getline(reject, name, ',');)
+      if (!name.empty())
+        sway.m_Rejected.insert(name);
+    if (!opt.inputs_file.empty())
+      sway.m_Inputs = read_json_file(opt.inputs_file);
+    if (!opt.outputs_file.empty())
+      sway.m_Outputs = read_json_file(opt.outputs_file);
+
+    if (!opt.serve.empty())
+      return serve(opt, sway);
+
+    // Behave like swaymsg.
+    auto type = ipc::GetMsgType(opt.type);
+    if (!type) {
+      std::cerr << "Unknown message type " << opt.type << std::endl;
+      return 1;
+    }
+    std::string reply = sway.Handle(type.value(), opt.command);
+    size_t logged = 0;
+    flush_log(opt, sway, logged);
+
+    // Like swaymsg, print command replies only when raw or on failure.
+    if (type != ipc::MsgType::run_command || opt.raw) {
+      std::cout << reply << std::endl;
+      return 0;
+    }
+    int ret = 0;
+    for (auto& res : mock::json::parse(reply)) {
+      if (!res.value("success", false)) {
+        std::cerr << "Error: " << res.value("error", "") << std::endl;
+        ret = 2;
+      }
+    }
+    return ret;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
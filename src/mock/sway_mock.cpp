@@ -0,0 +1,256 @@
+/**
+ * @brief Implementation of mock::SwayMock
+ * @file sway_mock.cpp
+ */
+#include "sway_mock.h"
+#include "../device_manager.h"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <thread>
+
+using namespace mock;
+
+SwayMock::SwayMock(int devices, int outputs)
+  : m_Inputs(GenerateInputs(devices))
+  , m_Outputs(GenerateOutputs(outputs))
+{}
+
+std::string SwayMock::Handle(ipc::MsgType type, const std::string& payload) {
+  if (m_Latency.count() > 0)
+    std::this_thread::sleep_for(m_Latency);
+
+  switch (type) {
+  case ipc::MsgType::get_inputs:
+    return m_Inputs.dump();
+  case ipc::MsgType::get_outputs:
+    return m_Outputs.dump();
+  case ipc::MsgType::run_command:
+    return runCommands(payload).dump();
+  case ipc::MsgType::subscribe:
+    return json{{"success", true}}.dump();
+  case ipc::MsgType::get_version:
+    return json{{"major", 1}, {"minor", 9}, {"patch", 0},
+                {"human_readable", "1.9-mock"},
+                {"loaded_config_file_name", ""}}.dump();
+  default:
+    return json::array().dump();
+  }
+}
+
+std::string SwayMock::Hotplug() {
+  json event;
+  if (m_unplugged.is_null()) {
+    if (m_Inputs.empty())
+      return "";
+    m_unplugged = m_Inputs.back();
+    m_Inputs.erase(m_Inputs.size() - 1);
+    event = {{"change", "removed"}, {"input", m_unplugged}};
+  } else {
+    m_Inputs.push_back(m_unplugged);
+    event = {{"change", "added"}, {"input", m_unplugged}};
+    m_unplugged = nullptr;
+  }
+  return event.dump();
+}
+
+std::string SwayMock::HotplugOutput() {
+  if (m_unpluggedOutput.is_null()) {
+    if (m_Outputs.empty())
+      return "";
+    m_unpluggedOutput = m_Outputs.back();
+    m_Outputs.erase(m_Outputs.size() - 1);
+  } else {
+    m_Outputs.push_back(m_unpluggedOutput);
+    m_unpluggedOutput = nullptr;
+  }
+  // Like sway, the event does not tell what changed.
+  return json{{"change", "unspecified"}}.dump();
+}
+
+json SwayMock::runCommands(const std::string& payload) {
+  json reply = json::array();
+  for (auto& args : tokenize(payload)) {
+    if (args.empty())
+      continue;
+    std::string error = runCommand(args);
+    if (error.empty()) {
+      reply.push_back({{"success", true}});
+      continue;
+    }
+    // Like sway, commands after the failed one are not run.
+    reply.push_back({{"success", false}, {"parse_error", false}, {"error", error}});
+    break;
+  }
+  return reply;
+}
+
+std::string SwayMock::runCommand(const std::vector<std::string>& args) {
+  if (args[0] != "input")
+    return "Unknown/invalid command '" + args[0] + "'";
+  if (args.size() < 4)
+    return "Invalid input command (expected at least 3 arguments)";
+
+  std::string cmd = args[0];
+  for (size_t i = 1; i < args.size(); i++)
+    cmd += " " + args[i];
+  m_Commands.push_back(cmd);
+
+  auto setting = GetSetting(args[2], false);
+  if (!setting)
+    return "Invalid input subcommand " + args[2];
+  if (m_Rejected.count(args[2]))
+    return args[2] + " is not supported by " + args[1];
+  if (m_Invalid.count(args[2]))
+    return "Invalid value for " + args[2];
+  std::string key = GetSettingName(setting.value());
+
+  // Apply the value to every matching device, so that next GET_INPUTS
+  // reflects it like sway would.
+  const std::string& id = args[1];
+  for (auto& dev : m_Inputs) {
+    if (id != "*" && dev["identifier"] != id && "type:" + dev["type"].get<std::string>() != id)
+      continue;
+
+    json& target = dev.contains(key) ? dev[key] : dev["libinput"][key];
+    if (target.is_null()) {
+      dev["libinput"].erase(key);
+      continue;
+    }
+    // Malformed number fails the command instead of the whole mock.
+    try {
+      if (target.is_array()) {
+        json values = target;
+        for (size_t i = 3; i < args.size() && i - 3 < values.size(); i++)
+          values[i - 3] = std::stof(args[i]);
+        target = std::move(values);
+      } else if (target.is_number_integer()) {
+        target = std::stoi(args[3]);
+      } else if (target.is_number()) {
+        target = std::stof(args[3]);
+      } else {
+        target = args[3];
+      }
+    } catch (const std::logic_error&) {
+      return "Invalid value for " + args[2];
+    }
+  }
+  return "";
+}
+
+json SwayMock::GenerateInputs(int count) {
+  const DevType types[] = {DevType::keyboard, DevType::pointer, DevType::touchpad,
+                           DevType::tablet_tool, DevType::tablet_pad, DevType::sw};
+
+  json inputs = json::array();
+  for (int i = 0; i < count; i++) {
+    DevType type = types[i % std::size(types)];
+    std::string name = "Mock " + GetTypeName(type) + " " + std::to_string(i);
+    std::string id_name = name;
+    std::replace(id_name.begin(), id_name.end(), ' ', '_');
+
+    json dev = {
+      {"identifier", std::to_string(1000 + i) + ":" + std::to_string(i) + ":" + id_name},
+      {"name", name},
+      {"vendor", 1000 + i},
+      {"product", i},
+      {"type", GetTypeName(type)},
+    };
+    json libinput = {{"send_events", "enabled"}};
+
+    switch (type) {
+    case DevType::keyboard:
+      dev["repeat_delay"] = 600;
+      dev["repeat_rate"] = 25;
+      dev["xkb_layout_names"] = {"English (US)"};
+      dev["xkb_active_layout_index"] = 0;
+      dev["xkb_active_layout_name"] = "English (US)";
+      break;
+    case DevType::touchpad:
+      libinput["tap"] = "enabled";
+      libinput["tap_button_map"] = "lrm";
+      libinput["tap_drag"] = "enabled";
+      libinput["tap_drag_lock"] = "disabled";
+      libinput["click_method"] = "button_areas";
+      libinput["dwt"] = "enabled";
+      libinput["dwtp"] = "enabled";
+      libinput["scroll_method"] = "two_finger";
+      [[fallthrough]];
+    case DevType::pointer:
+      dev["scroll_factor"] = 1.0;
+      libinput["accel_speed"] = 0.0;
+      libinput["accel_profile"] = "adaptive";
+      libinput["natural_scroll"] = "disabled";
+      libinput["left_handed"] = "disabled";
+      libinput["middle_emulation"] = "disabled";
+      if (type == DevType::pointer) {
+        libinput["scroll_method"] = "none";
+        libinput["scroll_button"] = 274;
+      }
+      break;
+    case DevType::tablet_tool:
+      libinput["calibration_matrix"] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0};
+      break;
+    default:
+      break;
+    }
+
+    dev["libinput"] = libinput;
+    inputs.push_back(dev);
+  }
+  return inputs;
+}
+
+json SwayMock::GenerateOutputs(int count) {
+  json outputs = json::array();
+  for (int i = 0; i < count; i++) {
+    outputs.push_back({
+      {"name", "HEADLESS-" + std::to_string(i + 1)},
+      {"make", "swic"},
+      {"model", "mock"},
+      {"active", true},
+      {"scale", 1.0},
+      {"transform", "normal"},
+      {"rect", {{"x", 1920 * i}, {"y", 0}, {"width", 1920}, {"height", 1080}}},
+    });
+  }
+  return outputs;
+}
+
+std::vector<std::vector<std::string>> mock::tokenize(const std::string& payload) {
+  std::vector<std::vector<std::string>> commands(1);
+  std::string cur;
+  bool in_arg = false;
+  char quote = 0;
+  const auto& flush = [&]() {
+    if (in_arg)
+      commands.back().push_back(std::move(cur));
+    cur.clear();
+    in_arg = false;
+  };
+  for (size_t i = 0; i < payload.size(); i++) {
+    char c = payload[i];
+    if (c == '\\' && i + 1 < payload.size()) {
+      cur += payload[++i];
+      in_arg = true;
+    } else if (quote) {
+      if (c == quote)
+        quote = 0;
+      else
+        cur += c;
+    } else if (c == '\'' || c == '"') {
+      quote = c;
+      in_arg = true;
+    } else if (c == ';') {
+      flush();
+      commands.emplace_back();
+    } else if (std::isspace((unsigned char)c)) {
+      flush();
+    } else {
+      cur += c;
+      in_arg = true;
+    }
+  }
+  flush();
+  return commands;
+}
@@ -0,0 +1,98 @@
+/**
+ * @brief Stand-in for sway used for testing and benchmarking without a session.
+ * @file sway_mock.h
+ *
+ * SwayMock serves canned or generated `get_inputs`/`get_outputs` replies and
+ * records every `input ...` command it receives. It is used in-process by
+ * benchmarks and by the `swic-swaymock` executable, which can act either as
+ * a `swaymsg` replacement or as a `$SWAYSOCK` server.
+ */
+#pragma once
+#include "../sway_ipc.h"
+#include <chrono>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace mock {
+  using json = nlohmann::json;
+
+  /// Mocked sway state and request handler.
+  class SwayMock {
+  public:
+    json m_Inputs = json::array();    ///< Reply to GET_INPUTS
+    json m_Outputs = json::array();   ///< Reply to GET_OUTPUTS
+    std::vector<std::string> m_Commands;  ///< All received `input ...` commands
+    std::chrono::microseconds m_Latency{0}; ///< Delay before every reply
+    /// Settings (names used in `input` commands) failing for every device.
+    std::set<std::string> m_Rejected;
+    /// Settings whose every value is refused.
+    std::set<std::string> m_Invalid;
+
+    /**
+     * @brief Create mock with generated devices and outputs.
+     * @param devices Number of input devices to generate.
+     * @param outputs Number of outputs to generate.
+     */
+    SwayMock(int devices = 4, int outputs = 1);
+
+    /**
+     * @brief Handle one request and return the reply payload.
+     *
+     * Waits for m_Latency before returning. Commands are recorded and
+     * applied to m_Inputs so that later GET_INPUTS reflect them.
+     */
+    std::string Handle(ipc::MsgType type, const std::string& payload);
+
+    /**
+     * @brief Unplug the last device or plug it back if it was unplugged.
+     * @return Payload of the corresponding `input` event.
+     */
+    std::string Hotplug();
+    /**
+     * @brief Disconnect the last output or connect it back.
+     * @return Payload of the corresponding `output` event.
+     */
+    std::string HotplugOutput();
+
+    /**
+     * @brief Generate `get_inputs` reply with `count` devices of mixed types.
+     *
+     * Types cycle through keyboard, pointer, touchpad, tablet tool, tablet pad
+     * and switch, so every DevType (including skipped ones) is represented.
+     */
+    static json GenerateInputs(int count);
+    /// Generate `get_outputs` reply with `count` outputs placed side by side.
+    static json GenerateOutputs(int count);
+
+  private:
+    json m_unplugged; ///< Device removed by Hotplug()
+    json m_unpluggedOutput; ///< Output removed by HotplugOutput()
+
+    /// Run `;` separated commands until one fails and return the RUN_COMMAND reply.
+    json runCommands(const std::string& payload);
+    /// Run single command. Returns error message on failure.
+    std::string runCommand(const std::vector<std::string>& args);
+  };
+
+  /// Transport answering requests by SwayMock in the same process.
+  class MockTransport : public ipc::Transport {
+  public:
+    MockTransport(SwayMock& sway) : m_sway(sway) {}
+    std::string Request(ipc::MsgType type, const std::string& payload) override {
+      return m_sway.Handle(type, payload);
+    }
+
+  private:
+    SwayMock& m_sway;
+  };
+
+  /**
+   * @brief Split command batch into commands and those into arguments.
+   *
+   * Like sway, commands are separated by `;` outside of quotes, and
+   * backslash escapes the next character (e.g. `\"` in a quoted name).
+   */
+  std::vector<std::vector<std::string>> tokenize(const std::string& payload);
+}
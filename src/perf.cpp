@@ -0,0 +1,131 @@
+/**
+ * @brief Implementation of performance counters
+ * @file perf.cpp
+ */
+#include "perf.h"
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <new>
+#include <time.h> // clock_gettime
+
+using namespace perf;
+
+namespace {
+  // Constant initialized, so they are usable from operator new at any time.
+  thread_local Subsystem t_subsystem = Subsystem::other;
+  thread_local uint64_t t_allocs = 0;
+}
+
+#ifdef SWIC_ALLOC_STATS
+void* operator new(std::size_t size) {
+  t_allocs++;
+  Allocs& allocs = stats().allocs[(int)t_subsystem];
+  allocs.count.Add();
+  allocs.bytes.Add(size);
+  if (void* ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+#endif
+
+void Histogram::Record(uint64_t us) {
+  int bucket = us == 0 ? 0 : std::bit_width(us) - 1;
+  if (bucket >= BUCKETS)
+    bucket = BUCKETS - 1;
+  m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  m_sum.fetch_add(us, std::memory_order_relaxed);
+
+  uint64_t max = m_max.load(std::memory_order_relaxed);
+  while (us > max && !m_max.compare_exchange_weak(max, us, std::memory_order_relaxed))
+    ;
+}
+
+uint64_t Histogram::Count() const {
+  uint64_t count = 0;
+  for (auto& b : m_buckets)
+    count += b.load(std::memory_order_relaxed);
+  return count;
+}
+
+double Histogram::Percentile(double p) const {
+  auto buckets = Buckets();
+  uint64_t count = 0;
+  for (auto b : buckets)
+    count += b;
+  if (count == 0)
+    return 0.0;
+
+  // Find bucket containing the rank and interpolate linearly inside it.
+  double rank = p * count;
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    if (buckets[i] == 0 || seen + buckets[i] < rank) {
+      seen += buckets[i];
+      continue;
+    }
+    double frac = (rank - seen) / buckets[i];
+    double val = BucketLow(i) + frac * (BucketHigh(i) - BucketLow(i));
+    return std::min(val, double(Max()));
+  }
+  return double(Max());
+}
+
+std::array<uint64_t, Histogram::BUCKETS> Histogram::Buckets() const {
+  std::array<uint64_t, BUCKETS> out;
+  for (int i = 0; i < BUCKETS; i++)
+    out[i] = m_buckets[i].load(std::memory_order_relaxed);
+  return out;
+}
+
+void Histogram::Reset() {
+  for (auto& b : m_buckets)
+    b.store(0, std::memory_order_relaxed);
+  m_sum.store(0, std::memory_order_relaxed);
+  m_max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t perf::now_us(Clock clock) {
+  timespec ts;
+  clock_gettime(clock == Clock::thread ? CLOCK_THREAD_CPUTIME_ID : CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t perf::thread_allocs() {
+  return t_allocs;
+}
+
+AllocScope::AllocScope(Subsystem subsystem) : m_prev(t_subsystem) {
+  t_subsystem = subsystem;
+}
+
+AllocScope::~AllocScope() {
+  t_subsystem = m_prev;
+}
+
+void Stats::Reset() {
+  frame.Reset();
+  editor.Reset();
+  apply.Reset();
+  revert.Reset();
+  discovery.Reset();
+  ipc_requests.Reset();
+  ipc_bytes_out.Reset();
+  ipc_bytes_in.Reset();
+  ipc_latency.Reset();
+  ipc_slow.Reset();
+  ipc_timeouts.Reset();
+  frame_allocs.Reset();
+  for (auto& a : allocs) {
+    a.count.Reset();
+    a.bytes.Reset();
+  }
+}
+
+Stats& perf::stats() {
+  // Constant initialized, operator new uses it before main().
+  static Stats s_stats;
+  return s_stats;
+}
@@ -0,0 +1,158 @@
+/**
+ * @brief Lock-free performance counters and latency histograms.
+ * @file perf.h
+ *
+ * All counters have fixed size and are updated with relaxed atomics, so
+ * they can be bumped from any thread without locking or allocating.
+ *
+ * Heap allocations are counted by replacement of the global operator new
+ * (in perf.cpp) in binaries built with SWIC_ALLOC_STATS defined (benchmarks,
+ * swic only with `-Dalloc_stats=true`). Allocations are attributed to the
+ * subsystem of the innermost AllocScope of the allocating thread.
+ */
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace perf {
+  using counter_t = std::atomic<uint64_t>;
+  static_assert(counter_t::is_always_lock_free, "perf counters must be lock-free");
+
+  /// Monotonically increasing counter.
+  class Counter {
+  public:
+    inline void Add(uint64_t n = 1) { m_val.fetch_add(n, std::memory_order_relaxed); }
+    inline uint64_t Get() const { return m_val.load(std::memory_order_relaxed); }
+    inline void Reset() { m_val.store(0, std::memory_order_relaxed); }
+
+  private:
+    counter_t m_val{0};
+  };
+
+  /**
+   * @brief Latency histogram with power of two buckets (in microseconds).
+   *
+   * Bucket `i` holds samples in range `[2^i, 2^(i+1))` us, bucket 0 also
+   * holds samples smaller than 1 us. The last bucket holds everything above.
+   */
+  class Histogram {
+  public:
+    static constexpr int BUCKETS = 32;
+
+    /// Record one sample.
+    void Record(uint64_t us);
+    /// Number of recorded samples.
+    uint64_t Count() const;
+    /// Sum of all recorded samples in microseconds.
+    inline uint64_t Sum() const { return m_sum.load(std::memory_order_relaxed); }
+    /// Largest recorded sample in microseconds.
+    inline uint64_t Max() const { return m_max.load(std::memory_order_relaxed); }
+    /// Approximate percentile (p in <0, 1>) in microseconds. 0 if empty.
+    double Percentile(double p) const;
+    /// Copy of bucket counts (not an atomic snapshot).
+    std::array<uint64_t, BUCKETS> Buckets() const;
+    void Reset();
+
+    /// Lower bound of bucket in microseconds.
+    static constexpr uint64_t BucketLow(int i) { return i == 0 ? 0 : uint64_t(1) << i; }
+    /// Upper bound of bucket in microseconds.
+    static constexpr uint64_t BucketHigh(int i) { return uint64_t(1) << (i + 1); }
+
+  private:
+    std::array<counter_t, BUCKETS> m_buckets{};
+    counter_t m_sum{0};
+    counter_t m_max{0};
+  };
+
+  /// Which clock should the ScopedTimer use.
+  enum class Clock {
+    wall,   ///< Monotonic wall clock
+    thread  ///< CPU time consumed by the calling thread
+  };
+
+  /// Current time of given clock in microseconds.
+  uint64_t now_us(Clock clock = Clock::wall);
+
+  /// Record duration of the enclosing scope into a histogram.
+  class ScopedTimer {
+  public:
+    ScopedTimer(Histogram& hist, Clock clock = Clock::wall)
+      : m_hist(hist), m_clock(clock), m_start(now_us(clock)) {}
+    ~ScopedTimer() { m_hist.Record(now_us(m_clock) - m_start); }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+  private:
+    Histogram& m_hist;
+    Clock m_clock;
+    uint64_t m_start;
+  };
+
+  /// Parts of the application heap allocations are attributed to.
+  enum class Subsystem : int {
+    other = 0, ///< Outside of any AllocScope
+    discovery, ///< Device discovery
+    apply,     ///< Applying and reverting changes
+    events,    ///< Handling of sway events
+    gui,       ///< Building GUI frames
+    size
+  };
+  /// Strings of Subsystem enum
+  constexpr std::array<const char*, (int)Subsystem::size> SUBSYSTEM_S = {
+      "other", "discovery", "apply", "events", "gui"};
+
+  /// Heap allocations made by one subsystem.
+  struct Allocs {
+    Counter count;
+    Counter bytes;
+  };
+
+  /// FALSE if heap allocations are not counted, all alloc counters stay 0.
+#ifdef SWIC_ALLOC_STATS
+  constexpr bool ALLOC_STATS = true;
+#else
+  constexpr bool ALLOC_STATS = false;
+#endif
+
+  /// Number of heap allocations made by the calling thread so far.
+  uint64_t thread_allocs();
+
+  /// Attribute heap allocations of the calling thread to a subsystem while in scope.
+  class AllocScope {
+  public:
+    AllocScope(Subsystem subsystem);
+    ~AllocScope();
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+  private:
+    Subsystem m_prev;
+  };
+
+  /// Requests blocking on sway longer are logged and counted as slow.
+  constexpr uint64_t SLOW_REQUEST_US = 100000;
+
+  /// All statistics collected by the application.
+  struct Stats {
+    Histogram frame;      ///< Time between frames without idle wait
+    Histogram editor;     ///< CPU time spent in DeviceEditor::OnUpdate
+    Histogram apply;      ///< DeviceMan::ApplyChanges latency
+    Histogram revert;     ///< DeviceMan::RevertChanges latency
+    Histogram discovery;  ///< Device discovery latency
+    Counter ipc_requests; ///< Number of requests sent to sway
+    Counter ipc_bytes_out;  ///< Bytes sent to sway
+    Counter ipc_bytes_in;   ///< Bytes received from sway
+    Histogram ipc_latency;  ///< Time blocked on a reply of sway
+    Counter ipc_slow;       ///< Requests slower than SLOW_REQUEST_US
+    Counter ipc_timeouts;   ///< Requests cancelled after their deadline
+    /// Heap allocations of the main thread per frame (counts, not microseconds)
+    Histogram frame_allocs;
+    std::array<Allocs, (int)Subsystem::size> allocs; ///< Heap allocations per subsystem
+
+    void Reset();
+  };
+
+  /// Global statistics instance.
+  Stats& stats();
+}
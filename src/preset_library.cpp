@@ -0,0 +1,250 @@
+/**
+ * @brief Implementation of PresetLibrary
+ * @file preset_library.cpp
+ */
+#include "preset_library.h"
+#include "sway_config.h"
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  constexpr char MAGIC[8] = {'S', 'W', 'I', 'C', 'P', 'R', 'E', 'S'};
+  // Version 1 used DevType::unknown for ANY_TYPE.
+  constexpr uint32_t VERSION = 2;
+  constexpr uint32_t EMPTY = UINT32_MAX;
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slots;   ///< Power of two, at least 8
+    uint32_t records;
+    uint32_t strings; ///< Size of the string pool
+  };
+
+  struct Record {
+    uint64_t hash;
+    uint32_t sway_id, sway_id_size;   ///< Identifier in the string pool
+    uint32_t settings, settings_size; ///< Settings in the string pool
+    uint32_t type;
+    uint32_t reserved;
+  };
+  static_assert(sizeof(Header) == 24 && sizeof(Record) == 32);
+
+  // FNV-1a of the identifier followed by the type.
+  uint64_t key_hash(std::string_view sway_id, DevType type) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : sway_id)
+      hash = (hash ^ (unsigned char)c) * 0x100000001b3;
+    return (hash ^ uint64_t(type)) * 0x100000001b3;
+  }
+
+  // Words which have to be quoted to stay a single argument.
+  bool needs_quotes(const std::string& word) {
+    return word.empty() || word.find_first_of(" \t\n;{}#'\"\\") != std::string::npos;
+  }
+}
+
+PresetLibrary::PresetLibrary(const std::string& path) : m_path(path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Failed to open preset library " + path);
+  struct stat st;
+  fstat(fd, &st);
+  void* data = st.st_size > 0 ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("Failed to read preset library " + path);
+  m_data = (const char*)data;
+  m_size = st.st_size;
+
+  // Only the sizes are checked here, records are checked when they are probed.
+  const Header* header = (const Header*)m_data;
+  if (m_size < sizeof(Header) || std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header->version != VERSION || header->slots < 8 || !std::has_single_bit(header->slots) ||
+      sizeof(Header) + uint64_t(header->slots) * sizeof(uint32_t) +
+              uint64_t(header->records) * sizeof(Record) + header->strings != m_size) {
+    munmap(data, m_size);
+    m_data = nullptr;
+    throw std::runtime_error(path + " is not a preset library");
+  }
+}
+
+PresetLibrary::~PresetLibrary() {
+  if (m_data)
+    munmap((void*)m_data, m_size);
+}
+
+std::string PresetLibrary::DefaultPath() {
+  std::filesystem::path dir;
+  if (const char* config = std::getenv("XDG_CONFIG_HOME"))
+    dir = config;
+  else if (const char* home = std::getenv("HOME"))
+    dir = std::filesystem::path(home) / ".config";
+  return (dir / "swic" / "presets.lib").string();
+}
+
+size_t PresetLibrary::Size() const {
+  return m_data ? ((const Header*)m_data)->records : 0;
+}
+
+std::optional<std::string_view> PresetLibrary::Find(std::string_view sway_id, DevType type) const {
+  if (!m_data)
+    return {};
+  const Header& header = *(const Header*)m_data;
+  const uint32_t* slots = (const uint32_t*)(m_data + sizeof(Header));
+  const Record* records = (const Record*)(slots + header.slots);
+  const char* strings = (const char*)(records + header.records);
+
+  uint64_t hash = key_hash(sway_id, type);
+  for (uint32_t probe = 0, slot = hash & (header.slots - 1); probe < header.slots;
+       probe++, slot = (slot + 1) & (header.slots - 1)) {
+    if (slots[slot] == EMPTY || slots[slot] >= header.records)
+      return {};
+    const Record& rec = records[slots[slot]];
+    if (rec.hash != hash || rec.type != uint32_t(type) ||
+        uint64_t(rec.sway_id) + rec.sway_id_size > header.strings ||
+        uint64_t(rec.settings) + rec.settings_size > header.strings)
+      continue;
+    if (std::string_view(strings + rec.sway_id, rec.sway_id_size) == sway_id)
+      return std::string_view(strings + rec.settings, rec.settings_size);
+  }
+  return {};
+}
+
+std::vector<PresetLibrary::Entry> PresetLibrary::Entries() const {
+  std::vector<Entry> entries;
+  if (!m_data)
+    return entries;
+  const Header& header = *(const Header*)m_data;
+  const Record* records = (const Record*)(m_data + sizeof(Header) + header.slots * sizeof(uint32_t));
+  const char* strings = (const char*)(records + header.records);
+  entries.reserve(header.records);
+  for (uint32_t i = 0; i < header.records; i++) {
+    const Record& rec = records[i];
+    if (uint64_t(rec.sway_id) + rec.sway_id_size > header.strings ||
+        uint64_t(rec.settings) + rec.settings_size > header.strings)
+      continue;
+    entries.push_back({std::string(strings + rec.sway_id, rec.sway_id_size), DevType(rec.type),
+                       std::string(strings + rec.settings, rec.settings_size)});
+  }
+  return entries;
+}
+
+void PresetLibrary::Write(const std::string& path, const std::vector<Entry>& entries) {
+  // Later entries replace earlier ones with the same key.
+  std::map<std::pair<std::string, DevType>, size_t> unique;
+  for (size_t i = 0; i < entries.size(); i++)
+    unique[{entries[i].sway_id, entries[i].type}] = i;
+
+  Header header;
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  // At most half of the slots are used, so that probe sequences stay short.
+  header.slots = std::bit_ceil(std::max<uint32_t>(8, unique.size() * 2));
+  header.records = unique.size();
+
+  std::vector<uint32_t> slots(header.slots, EMPTY);
+  std::vector<Record> records;
+  std::string strings;
+  records.reserve(unique.size());
+  for (auto& [key, index] : unique) {
+    const Entry& entry = entries[index];
+    Record rec{};
+    rec.hash = key_hash(entry.sway_id, entry.type);
+    rec.type = uint32_t(entry.type);
+    rec.sway_id = strings.size();
+    rec.sway_id_size = entry.sway_id.size();
+    strings += entry.sway_id;
+    rec.settings = strings.size();
+    rec.settings_size = entry.settings.size();
+    strings += entry.settings;
+
+    uint32_t slot = rec.hash & (header.slots - 1);
+    while (slots[slot] != EMPTY)
+      slot = (slot + 1) & (header.slots - 1);
+    slots[slot] = records.size();
+    records.push_back(rec);
+  }
+  header.strings = strings.size();
+
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+  // Library may be mapped by running instances, so it is replaced, never
+  // written in place. Unique temporary file, other instances may save their
+  // presets at the same time.
+  std::string tmp = path + ".XXXXXX";
+  int fd = mkstemp(tmp.data());
+  if (fd < 0)
+    throw std::runtime_error("Failed to create " + tmp);
+  fchmod(fd, 0644);
+  const auto& write_all = [fd](const void* data, size_t size) {
+    for (size_t written = 0; written < size;) {
+      ssize_t n = write(fd, (const char*)data + written, size - written);
+      if (n < 0)
+        return false;
+      written += n;
+    }
+    return true;
+  };
+  bool written = write_all(&header, sizeof(header)) &&
+                 write_all(slots.data(), slots.size() * sizeof(uint32_t)) &&
+                 write_all(records.data(), records.size() * sizeof(Record)) &&
+                 write_all(strings.data(), strings.size());
+  close(fd);
+  if (!written) {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("Failed to write " + tmp);
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("Failed to replace " + path);
+  }
+}
+
+std::vector<PresetLibrary::Entry> PresetLibrary::FromSwayConfig(const std::string& path) {
+  std::vector<Entry> entries;
+  // Sway merges blocks with the same identifier, so do their entries.
+  std::map<std::pair<std::string, DevType>, size_t> index;
+  for (auto& block : swaycfg::parse(path)) {
+    std::pair<std::string, DevType> key{block.identifier, ANY_TYPE};
+    if (block.identifier.starts_with("type:")) {
+      auto type = GetType(block.identifier.substr(5));
+      if (!type)
+        continue;
+      key = {"*", type.value()};
+    }
+    auto [it, added] = index.emplace(key, entries.size());
+    if (added)
+      entries.push_back({key.first, key.second, ""});
+    std::string& settings = entries[it->second].settings;
+    for (auto& setting : block.settings) {
+      settings += "   ";
+      for (auto& word : setting) {
+        settings += ' ';
+        if (needs_quotes(word)) {
+          settings += '"';
+          for (char c : word) {
+            if (c == '"' || c == '\\')
+              settings += '\\';
+            settings += c;
+          }
+          settings += '"';
+        } else {
+          settings += word;
+        }
+      }
+      settings += '\n';
+    }
+  }
+  return entries;
+}
@@ -0,0 +1,79 @@
+/**
+ * @brief Memory mapped library of device presets.
+ * @file preset_library.h
+ *
+ * Presets are settings of `input` blocks (`    accel_speed 0.5` lines)
+ * stored per device identifier and type. The library is a single binary
+ * file which is memory mapped when opened, nothing is parsed up front:
+ *
+ *     Header  magic, version, number of slots, records and string bytes
+ *     Slots   uint32_t record index per slot, open addressing hash table
+ *     Records hash of the key, type, identifier and settings in the pool
+ *     Strings identifiers and settings, not terminated
+ *
+ * Looking up preset of a device costs a few probes of the slot table, so
+ * opening a library with thousands of devices is as cheap as with one.
+ * Numbers are stored in native byte order.
+ */
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "device_manager.h"
+
+class PresetLibrary {
+public:
+  /// Type of entries applying to devices of any type, even DevType::unknown.
+  static constexpr DevType ANY_TYPE = DevType::size;
+
+  /// Preset of a device. Identifier `*` applies to all devices of the type.
+  struct Entry {
+    std::string sway_id;
+    DevType type;         ///< Device type or ANY_TYPE
+    std::string settings; ///< Lines of `input` block body
+  };
+
+  /// Empty library.
+  PresetLibrary() = default;
+  /**
+   * @brief Map library file.
+   * @exception std::runtime_error When the file can't be read or isn't a library.
+   */
+  PresetLibrary(const std::string& path);
+  ~PresetLibrary();
+  PresetLibrary(const PresetLibrary&) = delete;
+  PresetLibrary& operator=(const PresetLibrary&) = delete;
+
+  /// `$XDG_CONFIG_HOME/swic/presets.lib` (`~/.config` if not set).
+  static std::string DefaultPath();
+  inline const std::string& Path() const { return m_path; }
+
+  /**
+   * @brief Build library from entries and atomically replace the file.
+   *
+   * Later entries replace earlier ones with the same identifier and type.
+   * @exception std::runtime_error When the file can't be written.
+   */
+  static void Write(const std::string& path, const std::vector<Entry>& entries);
+  /**
+   * @brief Read entries from `input` blocks of sway config.
+   *
+   * `type:<type>` blocks become `*` entries of the type, other blocks are
+   * ANY_TYPE entries.
+   */
+  static std::vector<Entry> FromSwayConfig(const std::string& path);
+
+  /// Settings of the preset with exactly this identifier and type.
+  std::optional<std::string_view> Find(std::string_view sway_id, DevType type) const;
+  /// Copy of all entries, e.g. to Write() library with a changed entry.
+  std::vector<Entry> Entries() const;
+  size_t Size() const;
+  inline bool Empty() const { return Size() == 0; }
+
+private:
+  std::string m_path;
+  const char* m_data = nullptr;
+  size_t m_size = 0;
+};
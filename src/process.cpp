@@ -0,0 +1,122 @@
+/**
+ * @brief Implementation of Process
+ * @file process.cpp
+ */
+#include "process.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <climits>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <system_error>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+Process::Process(const std::vector<std::string>& args, bool capture_stderr) {
+  std::vector<char*> argv;
+  for (auto& arg : args)
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  argv.push_back(nullptr);
+
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) < 0)
+    throw std::system_error(errno, std::generic_category(), "pipe");
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+  if (capture_stderr)
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+  int err = posix_spawnp(&m_pid, argv[0], &actions, nullptr, argv.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+
+  close(fds[1]);
+  if (err != 0) {
+    close(fds[0]);
+    m_pid = -1;
+    throw std::system_error(err, std::generic_category(), args[0]);
+  }
+  m_fd = fds[0];
+}
+
+Process::~Process() {
+  if (m_pid > 0 && m_fd >= 0)
+    Kill(SIGTERM);
+  finish();
+}
+
+Process::Result Process::Run(const std::vector<std::string>& args) {
+  Process proc(args);
+  Result res;
+  res.status = proc.Wait(res.output);
+  return res;
+}
+
+bool Process::ReadAvailable(std::string& out) {
+  if (m_fd < 0)
+    return false;
+  int flags = fcntl(m_fd, F_GETFL);
+  if (!(flags & O_NONBLOCK))
+    fcntl(m_fd, F_SETFL, flags | O_NONBLOCK);
+
+  char buf[4096];
+  while (true) {
+    ssize_t n = read(m_fd, buf, sizeof(buf));
+    if (n > 0)
+      out.append(buf, n);
+    else if (n < 0 && errno == EINTR)
+      continue;
+    else
+      return n < 0 && errno == EAGAIN;
+  }
+}
+
+int Process::Wait(std::string& out) {
+  if (m_fd >= 0) {
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_NONBLOCK);
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(m_fd, buf, sizeof(buf))) != 0) {
+      if (n > 0)
+        out.append(buf, n);
+      else if (errno != EINTR)
+        break;
+    }
+  }
+  return finish();
+}
+
+std::optional<int> Process::Wait(std::string& out, std::chrono::steady_clock::time_point deadline) {
+  while (ReadAvailable(out)) {
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    if (left.count() <= 0)
+      return {};
+    pollfd pfd = {m_fd, POLLIN, 0};
+    poll(&pfd, 1, int(std::min<int64_t>(left.count(), INT_MAX)));
+  }
+  return finish();
+}
+
+void Process::Kill(int signal) {
+  if (m_pid > 0)
+    kill(m_pid, signal);
+}
+
+int Process::finish() {
+  if (m_fd >= 0)
+    close(m_fd);
+  m_fd = -1;
+  if (m_pid <= 0)
+    return -1;
+
+  int status = 0;
+  while (waitpid(m_pid, &status, 0) < 0 && errno == EINTR) {}
+  m_pid = -1;
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  return WEXITSTATUS(status);
+}
@@ -0,0 +1,65 @@
+/**
+ * @brief Child processes started without a shell.
+ * @file process.h
+ *
+ * Processes are started by posix_spawnp with argument vector, so arguments
+ * (device identifiers, commands) are passed as they are and don't need
+ * quoting. Output of the process is read through a pipe.
+ */
+#pragma once
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/// Running child process with captured output.
+class Process {
+public:
+  /// Output and exit status of finished process.
+  struct Result {
+    int status;         ///< Exit code, 128 + signal number if killed
+    std::string output; ///< Captured output
+  };
+
+  /**
+   * @brief Start process.
+   * @param args Program (searched in PATH) followed by its arguments.
+   * @param capture_stderr Capture stderr together with stdout.
+   * @exception std::system_error When the program can't be started (e.g. ENOENT).
+   */
+  Process(const std::vector<std::string>& args, bool capture_stderr = false);
+  /// Kill the process if still running and reap it.
+  ~Process();
+  Process(const Process&) = delete;
+  Process& operator=(const Process&) = delete;
+
+  /// Run process until it exits and return its stdout.
+  static Result Run(const std::vector<std::string>& args);
+
+  /**
+   * @brief Append output available so far without blocking.
+   * @return FALSE once the output is closed (process exited).
+   */
+  bool ReadAvailable(std::string& out);
+  /// Read remaining output, wait for exit and return exit status.
+  int Wait(std::string& out);
+  /**
+   * @brief Read output until the process exits or the deadline passes.
+   * @return Exit status, empty if the output is still open at the deadline.
+   */
+  std::optional<int> Wait(std::string& out, std::chrono::steady_clock::time_point deadline);
+  /// Send signal to the running process.
+  void Kill(int signal);
+
+  inline pid_t Pid() const { return m_pid; }
+  /// Read end of the output pipe, e.g. for poll().
+  inline int Fd() const { return m_fd; }
+
+private:
+  pid_t m_pid{-1};
+  int m_fd{-1};
+
+  /// Close pipe and reap the process. Returns exit status.
+  int finish();
+};
@@ -0,0 +1,154 @@
+/**
+ * @brief Implementation of SharedState
+ * @file shared_state.cpp
+ */
+#include "shared_state.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  constexpr char MAGIC[8] = {'S', 'W', 'I', 'C', 'S', 'T', 'A', 'T'};
+  constexpr uint32_t VERSION = 1;
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t pid;
+    uint64_t generation;
+    uint32_t sway_size;
+    uint32_t inputs_size;
+    uint32_t outputs_size;
+    uint32_t reserved;
+  };
+  static_assert(sizeof(Header) == 40);
+
+  /// Create directory only we may use, or check that the existing one is.
+  void make_private_dir(const std::string& dir) {
+    if (mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST)
+      throw std::runtime_error("Failed to create " + dir);
+    struct stat st;
+    if (lstat(dir.c_str(), &st) < 0)
+      throw std::runtime_error("Failed to stat " + dir);
+    if (!S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 0777) != 0700)
+      throw std::runtime_error(dir + " must be a directory owned by the user with mode 0700.");
+  }
+}
+
+SharedState::SharedState(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Failed to open shared state " + path);
+  struct stat st;
+  fstat(fd, &st);
+  void* data = st.st_size > 0 ? mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("Failed to read shared state " + path);
+  m_data = (const char*)data;
+  m_size = st.st_size;
+
+  const Header* header = (const Header*)m_data;
+  if (m_size < sizeof(Header) || std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header->version != VERSION ||
+      sizeof(Header) + uint64_t(header->sway_size) + header->inputs_size + header->outputs_size != m_size) {
+    munmap(data, m_size);
+    m_data = nullptr;
+    throw std::runtime_error(path + " is not a shared state snapshot");
+  }
+}
+
+SharedState::~SharedState() {
+  if (m_data)
+    munmap((void*)m_data, m_size);
+}
+
+std::string SharedState::RuntimeDir() {
+  if (const char* dir = std::getenv("XDG_RUNTIME_DIR"))
+    return (std::filesystem::path(dir) / "swic").string();
+  return "/tmp/swic-" + std::to_string(getuid());
+}
+
+std::string SharedState::PrivateRuntimeDir() {
+  std::string dir = RuntimeDir();
+  make_private_dir(dir);
+  return dir;
+}
+
+std::string SharedState::DefaultPath() {
+  return (std::filesystem::path(RuntimeDir()) / "state").string();
+}
+
+void SharedState::Write(const std::string& path, uint64_t generation, std::string_view sway,
+                        std::string_view inputs, std::string_view outputs) {
+  Header header{};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.pid = getpid();
+  header.generation = generation;
+  header.sway_size = sway.size();
+  header.inputs_size = inputs.size();
+  header.outputs_size = outputs.size();
+
+  // Only the user may read the state of their devices.
+  make_private_dir(std::filesystem::path(path).parent_path().string());
+  // Snapshot may be mapped by other instances, so it is replaced, never
+  // written in place.
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+      throw std::runtime_error("Failed to create " + tmp);
+    file.write((const char*)&header, sizeof(header));
+    file.write(sway.data(), sway.size());
+    file.write(inputs.data(), inputs.size());
+    file.write(outputs.data(), outputs.size());
+    if (!file) {
+      std::remove(tmp.c_str());
+      throw std::runtime_error("Failed to write " + tmp);
+    }
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("Failed to replace " + path);
+  }
+}
+
+uint64_t SharedState::Generation() const {
+  return ((const Header*)m_data)->generation;
+}
+
+pid_t SharedState::Pid() const {
+  return ((const Header*)m_data)->pid;
+}
+
+bool SharedState::Alive() const {
+  // Snapshot of a crashed instance stays behind until the next one starts.
+  return kill(Pid(), 0) == 0 || errno == EPERM;
+}
+
+std::string_view SharedState::Sway() const {
+  const Header& header = *(const Header*)m_data;
+  return std::string_view(m_data + sizeof(Header), header.sway_size);
+}
+
+std::string_view SharedState::Inputs() const {
+  const Header& header = *(const Header*)m_data;
+  return std::string_view(m_data + sizeof(Header) + header.sway_size, header.inputs_size);
+}
+
+std::string_view SharedState::Outputs() const {
+  const Header& header = *(const Header*)m_data;
+  return std::string_view(m_data + sizeof(Header) + header.sway_size + header.inputs_size,
+                          header.outputs_size);
+}
@@ -0,0 +1,71 @@
+/**
+ * @brief Device state published by a background swic instance.
+ * @file shared_state.h
+ *
+ * The background instance (`swic --daemon`) keeps replies of `get_inputs`
+ * and `get_outputs` up to date and publishes them in a file in the runtime
+ * directory (tmpfs). Other instances map the file read only and discover
+ * devices from it without querying sway:
+ *
+ *     Header  magic, version, pid of the publisher, generation, sizes
+ *     Strings sway socket, `get_inputs` reply, `get_outputs` reply
+ *
+ * Every update writes a new file and renames it over the old one, so a
+ * mapped snapshot never changes under its reader. Generation increases with
+ * every update. Numbers are stored in native byte order.
+ */
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+class SharedState {
+public:
+  /**
+   * @brief Map snapshot file.
+   * @exception std::runtime_error When the file can't be read or isn't a snapshot.
+   */
+  SharedState(const std::string& path);
+  ~SharedState();
+  SharedState(const SharedState&) = delete;
+  SharedState& operator=(const SharedState&) = delete;
+
+  /// `$XDG_RUNTIME_DIR/swic` (`/tmp/swic-<uid>` if not set).
+  static std::string RuntimeDir();
+  /**
+   * @brief Create RuntimeDir() if needed and check that only we can use it.
+   *
+   * Without $XDG_RUNTIME_DIR it is in `/tmp`, where another user may have
+   * created it first to get hold of our sockets.
+   * @return RuntimeDir()
+   * @exception std::runtime_error When it can't be created, is a symlink, is
+   *            owned by another user or its mode isn't 0700.
+   */
+  static std::string PrivateRuntimeDir();
+  /// Snapshot in RuntimeDir().
+  static std::string DefaultPath();
+  /**
+   * @brief Atomically replace the snapshot file.
+   * @param sway Socket of sway the replies came from, empty for swaymsg.
+   * @exception std::runtime_error When the file can't be written or its
+   *            directory isn't private (see PrivateRuntimeDir()).
+   */
+  static void Write(const std::string& path, uint64_t generation, std::string_view sway,
+                    std::string_view inputs, std::string_view outputs);
+
+  uint64_t Generation() const;
+  /// Process which published the snapshot.
+  pid_t Pid() const;
+  /// TRUE while the process which published the snapshot is running.
+  bool Alive() const;
+  std::string_view Sway() const;
+  /// Reply to `get_inputs`.
+  std::string_view Inputs() const;
+  /// Reply to `get_outputs`.
+  std::string_view Outputs() const;
+
+private:
+  const char* m_data = nullptr;
+  size_t m_size = 0;
+};
@@ -0,0 +1,130 @@
+/**
+ * @brief Implementation of SingleInstance
+ * @file single_instance.cpp
+ */
+#include "single_instance.h"
+#include "shared_state.h"
+#include "sway_ipc.h"
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+  // Message type of forwarded arguments, separated by NUL characters.
+  constexpr uint32_t ARGS_MESSAGE = 0;
+}
+
+SingleInstance::SingleInstance() {
+  std::filesystem::path dir;
+  try {
+    dir = SharedState::PrivateRuntimeDir();
+  } catch (const std::runtime_error& e) {
+    // Runs on its own, arguments are never sent to a socket of another user.
+    std::cerr << e.what() << std::endl;
+    return;
+  }
+  m_socketPath = (dir / "gui.sock").string();
+  m_lockFd = open((dir / "gui.lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  // Without a lock file every instance runs on its own, as before.
+  if (m_lockFd < 0 || flock(m_lockFd, LOCK_EX | LOCK_NB) < 0)
+    return;
+
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (m_socketPath.size() >= sizeof(addr.sun_path))
+    return;
+  m_socketPath.copy(addr.sun_path, m_socketPath.size());
+  // Socket of an instance which didn't exit cleanly, the lock is ours.
+  unlink(m_socketPath.c_str());
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+  m_listenFd = fd;
+}
+
+SingleInstance::~SingleInstance() {
+  if (m_thread.joinable()) {
+    m_stop->Signal();
+    m_thread.join();
+  }
+  if (m_listenFd >= 0) {
+    close(m_listenFd);
+    unlink(m_socketPath.c_str());
+  }
+  if (m_lockFd >= 0)
+    close(m_lockFd);
+}
+
+bool SingleInstance::Forward(const std::vector<std::string>& args) {
+  std::string payload;
+  for (auto& arg : args) {
+    payload += arg;
+    payload += '\0';
+  }
+  int fd = m_socketPath.empty() ? -1 : ipc::connect_socket(m_socketPath);
+  if (fd < 0)
+    return false;
+  bool sent = ipc::write_message(fd, ARGS_MESSAGE, payload);
+  close(fd);
+  return sent;
+}
+
+void SingleInstance::Listen(std::function<void()> on_message) {
+  if (!Primary() || m_thread.joinable())
+    return;
+  m_onMessage = std::move(on_message);
+  m_stop.emplace();
+  m_thread = std::thread(&SingleInstance::run, this);
+}
+
+std::vector<std::vector<std::string>> SingleInstance::Poll() {
+  std::lock_guard lock(m_mutex);
+  return std::exchange(m_queue, {});
+}
+
+void SingleInstance::run() {
+  while (true) {
+    pollfd fds[] = {{m_listenFd, POLLIN, 0}, {m_stop->Fd(), POLLIN, 0}};
+    if (poll(fds, 2, -1) <= 0)
+      continue;
+    if (fds[1].revents)
+      return;
+    int client = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0)
+      continue;
+    // Other instance sends everything at once, don't wait for a stuck one.
+    timeval timeout{1, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    auto msg = ipc::read_message(client);
+    close(client);
+    if (!msg || msg->type != ARGS_MESSAGE)
+      continue;
+
+    std::vector<std::string> args;
+    for (size_t start = 0; start < msg->payload.size();) {
+      size_t end = msg->payload.find('\0', start);
+      if (end == std::string::npos)
+        end = msg->payload.size();
+      args.push_back(msg->payload.substr(start, end - start));
+      start = end + 1;
+    }
+    {
+      std::lock_guard lock(m_mutex);
+      m_queue.push_back(std::move(args));
+    }
+    if (m_onMessage)
+      m_onMessage();
+  }
+}
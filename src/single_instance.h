@@ -0,0 +1,60 @@
+/**
+ * @brief One editor window per user session.
+ * @file single_instance.h
+ *
+ * The first instance holds a lock on `gui.lock` in SharedState::RuntimeDir()
+ * and listens on `gui.sock` next to it. Later instances find the lock taken,
+ * send their arguments over the socket and exit without creating a window
+ * or touching sway. The first instance then raises its window and handles
+ * the arguments. The lock is released by the kernel, so a crashed instance
+ * never blocks the next one.
+ */
+#pragma once
+#include "stop_event.h"
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+class SingleInstance {
+public:
+  /// Take the lock, or find out that another instance holds it.
+  SingleInstance();
+  ~SingleInstance();
+  SingleInstance(const SingleInstance&) = delete;
+  SingleInstance& operator=(const SingleInstance&) = delete;
+
+  /// TRUE if this is the first instance.
+  inline bool Primary() const { return m_listenFd >= 0; }
+
+  /**
+   * @brief Send arguments to the first instance.
+   * @return FALSE if it can't be reached.
+   */
+  bool Forward(const std::vector<std::string>& args);
+
+  /**
+   * @brief Start accepting arguments of other instances (first instance only).
+   *
+   * Instances started before this call wait in the socket backlog.
+   * @param on_message Called from the background thread when arguments arrive.
+   * @exception std::runtime_error When the thread can't be set up.
+   */
+  void Listen(std::function<void()> on_message);
+  /// Arguments sent by other instances since the last call.
+  std::vector<std::vector<std::string>> Poll();
+
+private:
+  int m_lockFd{-1};
+  int m_listenFd{-1};
+  std::string m_socketPath;
+  std::function<void()> m_onMessage;
+  std::optional<StopEvent> m_stop; ///< Set while listening
+  std::mutex m_mutex;
+  std::vector<std::vector<std::string>> m_queue;
+  std::thread m_thread;
+
+  void run();
+};
@@ -0,0 +1,25 @@
+/**
+ * @brief Implementation of StopEvent
+ * @file stop_event.cpp
+ */
+#include "stop_event.h"
+#include <cstdint>
+#include <stdexcept>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+StopEvent::StopEvent() : m_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+  if (m_fd < 0)
+    throw std::runtime_error("Failed to create eventfd.");
+}
+
+StopEvent::~StopEvent() {
+  close(m_fd);
+}
+
+void StopEvent::Signal() {
+  m_signaled = true;
+  uint64_t one = 1;
+  [[maybe_unused]] ssize_t n = write(m_fd, &one, sizeof(one));
+}
@@ -0,0 +1,32 @@
+/**
+ * @brief Stopping of background threads blocked in poll().
+ * @file stop_event.h
+ *
+ * Background threads (event pump, config watcher, single instance listener)
+ * and the daemon poll Fd() together with the descriptors they wait for and
+ * otherwise block indefinitely, so they don't wake up while the application
+ * is idle.
+ * Signal() makes the eventfd readable for good, nothing ever reads it.
+ */
+#pragma once
+#include <atomic>
+
+class StopEvent {
+public:
+  /// @exception std::runtime_error When the eventfd can't be created.
+  StopEvent();
+  ~StopEvent();
+  StopEvent(const StopEvent&) = delete;
+  StopEvent& operator=(const StopEvent&) = delete;
+
+  /// Wake up every poll() on Fd(), now and later.
+  void Signal();
+  /// TRUE once Signal() was called.
+  inline bool Signaled() const { return m_signaled; }
+  /// Readable once Signal() was called.
+  inline int Fd() const { return m_fd; }
+
+private:
+  int m_fd{-1};
+  std::atomic<bool> m_signaled{false};
+};
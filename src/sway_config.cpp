@@ -0,0 +1,281 @@
+/**
+ * @brief Implementation of sway config parsing
+ * @file sway_config.cpp
+ */
+#include "sway_config.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace swaycfg;
+
+namespace {
+  /// Maximal depth of nested includes, guards against include cycles.
+  constexpr int MAX_INCLUDE_DEPTH = 16;
+
+  struct CachedFile {
+    int64_t mtime_ns;
+    int64_t size;
+    std::shared_ptr<const std::vector<Token>> tokens;
+  };
+
+  std::mutex g_cache_mutex;
+  std::map<std::string, CachedFile> g_cache;
+
+  std::string env(const char* name) {
+    const char* val = std::getenv(name);
+    return val ? val : "";
+  }
+
+  // Replace `$name` variables defined by `set`.
+  void substitute(std::string& word, const std::map<std::string, std::string>& vars) {
+    if (word.find('$') == std::string::npos)
+      return;
+    // Longer names first, so that $mod2 is not replaced as $mod.
+    std::vector<const std::pair<const std::string, std::string>*> sorted;
+    for (auto& var : vars)
+      sorted.push_back(&var);
+    std::sort(sorted.begin(), sorted.end(),
+              [](auto* a, auto* b) { return a->first.size() > b->first.size(); });
+    for (auto* var : sorted) {
+      size_t pos = 0;
+      while ((pos = word.find(var->first, pos)) != std::string::npos) {
+        word.replace(pos, var->first.size(), var->second);
+        pos += var->second.size();
+      }
+    }
+  }
+
+  // Expand include pattern relative to directory of the including file.
+  std::vector<std::string> expand_include(const std::string& pattern, const std::string& from) {
+    std::string path = pattern;
+    if (!path.empty() && path[0] != '/' && path[0] != '~')
+      path = (std::filesystem::path(from).parent_path() / path).string();
+
+    std::vector<std::string> paths;
+    glob_t g;
+    if (glob(path.c_str(), GLOB_TILDE | GLOB_NOCHECK, nullptr, &g) == 0) {
+      for (size_t i = 0; i < g.gl_pathc; i++)
+        paths.push_back(g.gl_pathv[i]);
+      globfree(&g);
+    }
+    return paths;
+  }
+
+  class Parser {
+  public:
+    std::vector<InputBlock> m_Blocks;
+
+    void ParseFile(const std::string& path, int depth) {
+      std::error_code ec;
+      std::string canonical = std::filesystem::canonical(path, ec).string();
+      if (ec || depth > MAX_INCLUDE_DEPTH || !m_visited.insert(canonical).second)
+        return;
+
+      auto file = tokenize_file(canonical);
+      const std::vector<Token>& tokens = *file;
+      size_t pos = 0;
+      std::vector<std::string> words;
+      while (pos < tokens.size()) {
+        if (!nextStatement(tokens, pos, words)) {
+          pos++; // Unmatched `}`.
+          continue;
+        }
+        bool block = pos < tokens.size() && tokens[pos].kind == Token::open;
+        if (block)
+          pos++;
+        if (words.empty()) {
+          if (block)
+            skipBlock(tokens, pos);
+          continue;
+        }
+
+        if (words[0] == "set" && words.size() >= 3 && !block) {
+          std::string value;
+          for (size_t i = 2; i < words.size(); i++) {
+            substitute(words[i], m_vars);
+            value += (i > 2 ? " " : "") + words[i];
+          }
+          m_vars[words[1]] = value;
+          continue;
+        }
+
+        for (auto& word : words)
+          substitute(word, m_vars);
+        if (words[0] == "include" && !block) {
+          for (size_t i = 1; i < words.size(); i++)
+            for (auto& included : expand_include(words[i], canonical))
+              ParseFile(included, depth + 1);
+        } else if (words[0] == "input" && words.size() >= 2) {
+          InputBlock input{words[1], {}};
+          if (block) {
+            std::vector<std::string> setting;
+            while (nextStatement(tokens, pos, setting)) {
+              if (pos < tokens.size() && tokens[pos].kind == Token::open) {
+                pos++;
+                skipBlock(tokens, pos);
+              } else if (!setting.empty()) {
+                for (auto& word : setting)
+                  substitute(word, m_vars);
+                input.settings.push_back(setting);
+              }
+            }
+            pos++; // `}`
+          } else if (words.size() >= 3) {
+            input.settings.emplace_back(words.begin() + 2, words.end());
+          }
+          m_Blocks.push_back(std::move(input));
+        } else if (block) {
+          skipBlock(tokens, pos);
+        }
+      }
+    }
+
+  private:
+    std::map<std::string, std::string> m_vars;
+    std::set<std::string> m_visited;
+
+    // Read words of the next statement. Stops before `{` or `}`.
+    // Returns FALSE at the end of tokens or at `}` closing current block.
+    bool nextStatement(const std::vector<Token>& tokens, size_t& pos,
+                       std::vector<std::string>& words) {
+      words.clear();
+      while (pos < tokens.size() && tokens[pos].kind == Token::end)
+        pos++;
+      if (pos >= tokens.size() || tokens[pos].kind == Token::close)
+        return false;
+      for (; pos < tokens.size() && tokens[pos].kind == Token::word; pos++)
+        words.push_back(tokens[pos].text);
+      return true;
+    }
+
+    // Skip tokens until `}` matching already consumed `{`.
+    void skipBlock(const std::vector<Token>& tokens, size_t& pos) {
+      for (int depth = 1; pos < tokens.size() && depth > 0; pos++) {
+        if (tokens[pos].kind == Token::open)
+          depth++;
+        else if (tokens[pos].kind == Token::close)
+          depth--;
+      }
+    }
+  };
+}
+
+std::vector<Token> swaycfg::tokenize(std::string_view text) {
+  std::vector<Token> tokens;
+  std::string word;
+  bool in_word = false;
+  bool line_start = true; // Only whole lines can be comments.
+  const auto& flush = [&]() {
+    if (in_word)
+      tokens.push_back({Token::word, std::move(word)});
+    word.clear();
+    in_word = false;
+  };
+  const auto& push = [&](Token::Kind kind) {
+    flush();
+    if (kind == Token::end && (tokens.empty() || tokens.back().kind == Token::end))
+      return;
+    tokens.push_back({kind, ""});
+  };
+
+  for (size_t i = 0; i < text.size(); i++) {
+    char c = text[i];
+    if (c == '\\' && i + 1 < text.size() && text[i + 1] == '\n') {
+      i++; // Line continuation.
+    } else if (c == '#' && line_start) {
+      while (i + 1 < text.size() && text[i + 1] != '\n')
+        i++;
+    } else if (c == '"' || c == '\'') {
+      in_word = true;
+      line_start = false;
+      for (i++; i < text.size() && text[i] != c; i++) {
+        if (c == '"' && text[i] == '\\' && i + 1 < text.size())
+          i++;
+        word += text[i];
+      }
+    } else if (c == '\n' || c == ';') {
+      push(Token::end);
+      line_start = c == '\n';
+    } else if (c == '{') {
+      push(Token::open);
+    } else if (c == '}') {
+      push(Token::close);
+    } else if (std::isspace((unsigned char)c)) {
+      flush();
+    } else {
+      word += c;
+      in_word = true;
+      line_start = false;
+    }
+  }
+  push(Token::end);
+  return tokens;
+}
+
+std::shared_ptr<const std::vector<Token>> swaycfg::tokenize_file(const std::string& path) {
+  auto tokens = std::make_shared<std::vector<Token>>();
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return tokens;
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return tokens;
+  }
+  int64_t mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+  {
+    std::lock_guard lock(g_cache_mutex);
+    auto it = g_cache.find(path);
+    if (it != g_cache.end() && it->second.mtime_ns == mtime && it->second.size == st.st_size) {
+      close(fd);
+      return it->second.tokens;
+    }
+  }
+
+  if (st.st_size > 0) {
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      *tokens = tokenize(std::string_view((const char*)data, st.st_size));
+      munmap(data, st.st_size);
+    }
+  }
+  close(fd);
+
+  std::lock_guard lock(g_cache_mutex);
+  g_cache[path] = {mtime, st.st_size, tokens};
+  return tokens;
+}
+
+std::vector<InputBlock> swaycfg::parse(const std::string& path) {
+  Parser parser;
+  parser.ParseFile(path, 0);
+  return std::move(parser.m_Blocks);
+}
+
+std::string swaycfg::default_path() {
+  // Same order as sway's get_config_path().
+  std::string home = env("HOME");
+  std::string config_home = env("XDG_CONFIG_HOME");
+  if (config_home.empty() && !home.empty())
+    config_home = home + "/.config";
+
+  std::vector<std::string> paths = {home + "/.sway/config", config_home + "/sway/config",
+                                    home + "/.i3/config", config_home + "/i3/config",
+                                    "/etc/sway/config", "/etc/i3/config"};
+  for (auto& path : paths)
+    if (access(path.c_str(), R_OK) == 0)
+      return path;
+  return "";
+}
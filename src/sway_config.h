@@ -0,0 +1,56 @@
+/**
+ * @brief Reads `input` blocks from the user's sway config.
+ * @file sway_config.h
+ *
+ * Some settings (xkb_capslock, map_to_output, tool_mode...) can't be read
+ * back from sway, so they are taken from the config sway was started with.
+ * Only `set` variables, `include` and `input` statements are interpreted,
+ * everything else is skipped.
+ */
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace swaycfg {
+  /// Token of sway config.
+  struct Token {
+    enum Kind : uint8_t {
+      word,  ///< Word or quoted string (quotes removed)
+      open,  ///< `{`
+      close, ///< `}`
+      end,   ///< End of statement (new line or `;`)
+    } kind;
+    std::string text;
+  };
+
+  /// `input` block or single line `input` command.
+  struct InputBlock {
+    std::string identifier; ///< Device identifier, `type:<type>` or `*`
+    /// Settings in order of appearance, each is name followed by arguments.
+    std::vector<std::vector<std::string>> settings;
+  };
+
+  /**
+   * @brief Split file into tokens.
+   *
+   * The file is memory mapped and the tokens are cached by path, so the file
+   * is tokenized again only when its modification time or size changes.
+   * @return No tokens if the file can't be read.
+   */
+  std::shared_ptr<const std::vector<Token>> tokenize_file(const std::string& path);
+
+  /// Split sway config text into tokens.
+  std::vector<Token> tokenize(std::string_view text);
+
+  /**
+   * @brief Parse config and files included by it.
+   * @return All `input` blocks in order in which sway reads them.
+   */
+  std::vector<InputBlock> parse(const std::string& path);
+
+  /// Config sway reads when started without `-c`, empty if there is none.
+  std::string default_path();
+}
@@ -0,0 +1,55 @@
+/**
+ * @brief Implementation of setting value formatting
+ * @file sway_format.cpp
+ */
+#include "sway_format.h"
+#include <charconv>
+
+template <typename T> static void append_number(std::string& out, T value) {
+  char buf[32];
+  auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+  out.append(buf, end);
+}
+
+void swayfmt::append(std::string& out, int value) { append_number(out, value); }
+void swayfmt::append(std::string& out, float value) { append_number(out, value); }
+void swayfmt::append(std::string& out, bool value) { out += value ? "enabled" : "disabled"; }
+
+void swayfmt::append(std::string& out, const std::string& value) {
+  out += '"';
+  for (char c : value) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+  out += '"';
+}
+
+void swayfmt::append(std::string& out, const SEnum& value) {
+  if (value.sel < 0 || value.sel >= (int)value.options.size())
+    throw std::out_of_range("No enum is selected or corrupted index (" +
+                            std::to_string(value.sel) + ")");
+  out += value.options[value.sel];
+}
+
+void swayfmt::append(std::string& out, const CalArr& value) {
+  for (size_t i = 0; i < value.size(); i++) {
+    if (i)
+      out += ' ';
+    append(out, value[i]);
+  }
+}
+
+void swayfmt::append(std::string& out, const std::pair<SEnum, SEnum>& value) {
+  append(out, value.first);
+  out += ' ';
+  append(out, value.second);
+}
+
+void swayfmt::append(std::string& out, const std::array<int, 4>& value) {
+  for (size_t i = 0; i < value.size(); i++) {
+    if (i)
+      out += ' ';
+    append(out, value[i]);
+  }
+}
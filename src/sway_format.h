@@ -0,0 +1,54 @@
+/**
+ * @brief Formatting of setting values for sway commands and config.
+ * @file sway_format.h
+ *
+ * All functions append to the given buffer, so that a buffer reused for
+ * many settings (command batch, config export) doesn't allocate once it
+ * has grown. Numbers are written by std::to_chars, floats in the shortest
+ * form which reads back to the same value ("0.5" instead of "0.500000").
+ */
+#pragma once
+#include "device_manager.h"
+
+namespace swayfmt {
+  void append(std::string& out, int value);
+  void append(std::string& out, float value);
+  /// `enabled` or `disabled`.
+  void append(std::string& out, bool value);
+  /**
+   * @brief Quoted, so that empty value (e.g. no variant) is still an argument.
+   *
+   * `"` and `\` are escaped, a device name can't end the quotes or the command.
+   */
+  void append(std::string& out, const std::string& value);
+  /// Selected option.
+  void append(std::string& out, const SEnum& value);
+  /// Calibration matrix.
+  void append(std::string& out, const CalArr& value);
+  /// Tool mode, `<tool> <mode>`.
+  void append(std::string& out, const std::pair<SEnum, SEnum>& value);
+  /// Region, `<x> <y> <w> <h>`.
+  void append(std::string& out, const std::array<int, 4>& value);
+
+  /// Append `input "<id>" <setting> <value>;` to command batch.
+  template <typename T>
+  void command(std::string& out, const std::string& sway_id, SwaySetting setting, const T& value) {
+    out += "input ";
+    append(out, sway_id);
+    out += ' ';
+    out += GetSettingName(setting, false);
+    out += ' ';
+    append(out, value);
+    out += ';';
+  }
+
+  /// Append `    <setting> <value>` line of config `input` block.
+  template <typename T>
+  void config_line(std::string& out, SwaySetting setting, const T& value) {
+    out += "    ";
+    out += GetSettingName(setting, false);
+    out += ' ';
+    append(out, value);
+    out += '\n';
+  }
+}
@@ -0,0 +1,432 @@
+/**
+ * @brief Implementation of sway IPC message framing
+ * @file sway_ipc.cpp
+ */
+#include "sway_ipc.h"
+#include "process.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib> // getenv
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <system_error>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility> // std::exchange
+
+using namespace ipc;
+
+namespace {
+  struct MsgTypeName {
+    MsgType type;
+    std::string_view name;
+  };
+
+  constexpr std::array<MsgTypeName, 15> MSG_TYPE_NAMES = {{
+    {MsgType::run_command, "command"},
+    {MsgType::get_workspaces, "get_workspaces"},
+    {MsgType::subscribe, "subscribe"},
+    {MsgType::get_outputs, "get_outputs"},
+    {MsgType::get_tree, "get_tree"},
+    {MsgType::get_marks, "get_marks"},
+    {MsgType::get_bar_config, "get_bar_config"},
+    {MsgType::get_version, "get_version"},
+    {MsgType::get_binding_modes, "get_binding_modes"},
+    {MsgType::get_config, "get_config"},
+    {MsgType::send_tick, "send_tick"},
+    {MsgType::sync, "sync"},
+    {MsgType::get_binding_state, "get_binding_state"},
+    {MsgType::get_inputs, "get_inputs"},
+    {MsgType::get_seats, "get_seats"},
+  }};
+
+  // Write exactly `len` bytes, retrying on partial writes. Doesn't raise
+  // SIGPIPE when writing to closed socket.
+  bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+      ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+      if (n < 0 && errno == ENOTSOCK)
+        n = ::write(fd, data, len);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  // Poll single descriptor until the deadline. Returns 0 once it passed.
+  int poll_until(pollfd& pfd, std::chrono::steady_clock::time_point deadline) {
+    while (true) {
+      auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0)
+        return 0;
+      int n = poll(&pfd, 1, int(std::min<int64_t>(left.count(), INT_MAX)));
+      if (n == 0 || (n < 0 && errno == EINTR))
+        continue;
+      return n;
+    }
+  }
+
+  std::string timeout_message(MsgType type, std::chrono::milliseconds timeout) {
+    return "Sway didn't reply to " + std::string(GetMsgTypeName(type)) + " within " +
+           std::to_string(timeout.count()) + " ms.";
+  }
+
+  // Read exactly `len` bytes, retrying on partial reads.
+  bool read_all(int fd, char* data, size_t len) {
+    while (len > 0) {
+      ssize_t n = ::read(fd, data, len);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+}
+
+std::optional<MsgType> ipc::GetMsgType(std::string_view name) {
+  for (auto& t : MSG_TYPE_NAMES)
+    if (t.name == name)
+      return t.type;
+  return {};
+}
+
+std::string_view ipc::GetMsgTypeName(MsgType type) {
+  for (auto& t : MSG_TYPE_NAMES)
+    if (t.type == type)
+      return t.name;
+  return "unknown";
+}
+
+std::string ipc::encode(uint32_t type, std::string_view payload) {
+  std::string out;
+  out.resize(HEADER_SIZE + payload.size());
+  uint32_t len = payload.size();
+  std::memcpy(out.data(), MAGIC.data(), MAGIC.size());
+  std::memcpy(out.data() + MAGIC.size(), &len, sizeof(len));
+  std::memcpy(out.data() + MAGIC.size() + sizeof(len), &type, sizeof(type));
+  std::memcpy(out.data() + HEADER_SIZE, payload.data(), payload.size());
+  return out;
+}
+
+bool ipc::decode_header(const char* header, uint32_t& out_len, uint32_t& out_type) {
+  if (std::memcmp(header, MAGIC.data(), MAGIC.size()) != 0)
+    return false;
+  std::memcpy(&out_len, header + MAGIC.size(), sizeof(out_len));
+  std::memcpy(&out_type, header + MAGIC.size() + sizeof(out_len), sizeof(out_type));
+  return true;
+}
+
+bool ipc::write_message(int fd, uint32_t type, std::string_view payload) {
+  std::string msg = encode(type, payload);
+  return write_all(fd, msg.data(), msg.size());
+}
+
+std::optional<Message> ipc::read_message(int fd) {
+  char header[HEADER_SIZE];
+  if (!read_all(fd, header, HEADER_SIZE))
+    return {};
+
+  Message msg;
+  uint32_t len;
+  if (!decode_header(header, len, msg.type))
+    return {};
+  msg.payload.resize(len);
+  if (!read_all(fd, msg.payload.data(), len))
+    return {};
+  return msg;
+}
+
+Transport::Ticket Transport::Submit(MsgType type, const std::string& payload) {
+  m_queued.emplace_back(type, payload);
+  return m_queuedFirst + m_queued.size() - 1;
+}
+
+std::string Transport::Wait(Ticket ticket) {
+  Ready(ticket);
+  auto it = m_replies.find(ticket);
+  if (it == m_replies.end() && ticket >= m_cancelledFirst && ticket < m_cancelledEnd)
+    throw TimeoutError("Request " + std::to_string(ticket) + " was cancelled after a timeout.");
+  if (it == m_replies.end())
+    throw std::runtime_error("No reply for request " + std::to_string(ticket) + ".");
+  std::string reply = std::move(it->second);
+  m_replies.erase(it);
+  return reply;
+}
+
+bool Transport::Ready(Ticket ticket) {
+  // Run queued requests up to the ticket in order of submission.
+  while (!m_queued.empty() && m_queuedFirst <= ticket) {
+    auto [type, payload] = std::move(m_queued.front());
+    m_queued.pop_front();
+    Ticket current = m_queuedFirst++;
+    try {
+      m_replies[current] = Request(type, payload);
+    } catch (const TimeoutError&) {
+      // Requests queued after it are cancelled too, like on the socket.
+      m_cancelledFirst = current;
+      m_queuedFirst += m_queued.size();
+      m_cancelledEnd = m_queuedFirst;
+      m_queued.clear();
+      throw;
+    }
+  }
+  return m_replies.count(ticket);
+}
+
+std::string SwaymsgTransport::Request(MsgType type, const std::string& payload) {
+  std::vector<std::string> args = {m_swaymsg, "-t", std::string(GetMsgTypeName(type)), "--raw"};
+  if (!payload.empty()) {
+    args.push_back("--");
+    args.push_back(payload);
+  }
+
+  std::string output;
+  std::optional<int> status;
+  try {
+    Process proc(args);
+    status = proc.Wait(output, std::chrono::steady_clock::now() + m_timeout);
+    // Stuck swaymsg is reaped by the destructor.
+    if (!status)
+      proc.Kill(SIGKILL);
+  } catch (const std::system_error& e) {
+    throw std::runtime_error("Failed to call swaymsg (" + std::string(e.what()) + ").");
+  }
+  if (!status)
+    throw TimeoutError(timeout_message(type, m_timeout));
+  if (output.empty())
+    throw std::runtime_error("No reply from swaymsg (exit status " + std::to_string(status.value()) + ").");
+  return output;
+}
+
+int ipc::connect_socket(const std::string& path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path))
+    return -1;
+  path.copy(addr.sun_path, path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+SocketTransport::SocketTransport(const std::string& socket_path) : m_path(socket_path) {
+  m_fd = connect_socket(m_path);
+  if (m_fd < 0)
+    throw std::runtime_error("Failed to connect to sway socket " + m_path);
+}
+
+SocketTransport::~SocketTransport() {
+  if (m_fd >= 0)
+    close(m_fd);
+  if (m_eventFd >= 0)
+    close(m_eventFd);
+}
+
+std::string SocketTransport::Request(MsgType type, const std::string& payload) {
+  return Wait(Submit(type, payload));
+}
+
+Transport::Ticket SocketTransport::Submit(MsgType type, const std::string& payload) {
+  if (m_fd < 0) {
+    m_fd = connect_socket(m_path);
+    if (m_fd < 0)
+      throw std::runtime_error("Failed to connect to sway socket " + m_path);
+  }
+  Clock::time_point deadline = Clock::now() + m_timeout;
+  std::string msg = encode(type, payload);
+  size_t sent = 0;
+  while (sent < msg.size()) {
+    ssize_t n = ::send(m_fd, msg.data() + sent, msg.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n > 0) {
+      sent += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // Sway may stop reading requests until its replies are read, so keep
+      // reading them while the socket is full.
+      pollfd pfd = {m_fd, POLLIN | POLLOUT, 0};
+      if (poll_until(pfd, deadline) == 0)
+        cancel(uint32_t(type));
+      if (pfd.revents & POLLIN)
+        receive(false);
+      continue;
+    }
+    throw std::runtime_error("Failed to send request to sway.");
+  }
+  m_inFlight.push_back({uint32_t(type), deadline});
+  return m_submitted++;
+}
+
+std::string SocketTransport::Wait(Ticket ticket) {
+  auto it = m_replies.find(ticket);
+  while (it == m_replies.end()) {
+    if (ticket >= m_cancelledFirst && ticket < m_cancelledEnd)
+      throw TimeoutError("Request " + std::to_string(ticket) + " was cancelled after a timeout.");
+    if (ticket >= m_submitted || ticket < m_received)
+      throw std::runtime_error("No reply for request " + std::to_string(ticket) + ".");
+    receive(true);
+    it = m_replies.find(ticket);
+  }
+  std::string reply = std::move(it->second);
+  m_replies.erase(it);
+  return reply;
+}
+
+bool SocketTransport::Ready(Ticket ticket) {
+  if (ticket >= m_received && ticket < m_submitted)
+    receive(false);
+  return m_replies.count(ticket);
+}
+
+void SocketTransport::receive(bool block) {
+  Ticket received = m_received;
+  char buf[16384];
+  while (true) {
+    bool wait = block && m_received == received;
+    if (wait) {
+      pollfd pfd = {m_fd, POLLIN, 0};
+      if (poll_until(pfd, m_inFlight.front().deadline) == 0)
+        cancel(m_inFlight.front().type);
+    }
+    ssize_t n = ::recv(m_fd, buf, sizeof(buf), wait ? 0 : MSG_DONTWAIT);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && !wait && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    if (n <= 0)
+      throw std::runtime_error("Failed to read reply from sway.");
+    m_readBuf.append(buf, n);
+
+    // Replies come in order of requests.
+    size_t pos = 0;
+    uint32_t len, type;
+    while (m_readBuf.size() - pos >= HEADER_SIZE) {
+      if (!decode_header(m_readBuf.data() + pos, len, type))
+        throw std::runtime_error("Invalid reply from sway.");
+      if (m_readBuf.size() - pos - HEADER_SIZE < len) {
+        m_readBuf.reserve(pos + HEADER_SIZE + len);
+        break;
+      }
+      if (m_inFlight.empty() || m_inFlight.front().type != type)
+        throw std::runtime_error("Unexpected reply from sway.");
+      m_inFlight.pop_front();
+      m_replies.emplace(m_received++, m_readBuf.substr(pos + HEADER_SIZE, len));
+      pos += HEADER_SIZE + len;
+    }
+    m_readBuf.erase(0, pos);
+  }
+}
+
+void SocketTransport::cancel(uint32_t type) {
+  m_cancelledFirst = m_received;
+  m_cancelledEnd = m_submitted;
+  m_received = m_submitted;
+  m_inFlight.clear();
+  m_readBuf.clear();
+  close(m_fd);
+  // Submit() tries again if sway doesn't accept the connection now.
+  m_fd = connect_socket(m_path);
+  throw TimeoutError(timeout_message(MsgType(type), m_timeout));
+}
+
+bool SocketTransport::Subscribe(const std::string& events) {
+  // Events are received on separate connection, so that they are never
+  // interleaved with replies to requests.
+  if (m_eventFd < 0)
+    m_eventFd = connect_socket(m_path);
+  if (m_eventFd < 0 || !write_message(m_eventFd, uint32_t(MsgType::subscribe), events))
+    return false;
+  pollfd pfd = {m_eventFd, POLLIN, 0};
+  std::optional<Message> reply;
+  if (poll_until(pfd, Clock::now() + m_timeout) > 0)
+    reply = read_message(m_eventFd);
+  // Without events the devices are only discovered on start.
+  if (!reply) {
+    close(m_eventFd);
+    m_eventFd = -1;
+    return false;
+  }
+  return reply->payload.find("true") != std::string::npos;
+}
+
+std::optional<Message> SocketTransport::NextEvent(int stop_fd) {
+  if (m_eventFd < 0)
+    return {};
+  pollfd fds[] = {{m_eventFd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+  if (poll(fds, 2, -1) <= 0 || fds[1].revents)
+    return {};
+  auto msg = read_message(m_eventFd);
+  if (!msg)
+    throw std::runtime_error("Sway closed the event connection.");
+  return msg;
+}
+
+EventPump::EventPump(Transport& transport, const std::string& events,
+                     std::function<void()> on_event)
+  : m_transport(transport)
+  , m_onEvent(std::move(on_event))
+{
+  if (m_transport.Subscribe(events))
+    m_thread = std::thread(&EventPump::run, this);
+}
+
+EventPump::~EventPump() {
+  m_stop.Signal();
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+std::vector<Message> EventPump::Poll() {
+  std::lock_guard lock(m_mutex);
+  return std::exchange(m_queue, {});
+}
+
+void EventPump::run() {
+  try {
+    while (!m_stop.Signaled()) {
+      auto msg = m_transport.NextEvent(m_stop.Fd());
+      if (!msg)
+        continue;
+      {
+        std::lock_guard lock(m_mutex);
+        m_queue.push_back(std::move(msg.value()));
+      }
+      if (m_onEvent)
+        m_onEvent();
+    }
+  } catch (const std::runtime_error&) {
+    // Connection closed, there will be no more events.
+  }
+}
+
+std::unique_ptr<Transport> ipc::connect(const std::string& swaymsg_path, bool native) {
+  const char* sock = std::getenv("SWAYSOCK");
+  if (native && sock) {
+    try {
+      return std::make_unique<SocketTransport>(sock);
+    } catch (const std::runtime_error&) {
+      // Fall back to swaymsg below.
+    }
+  }
+  return std::make_unique<SwaymsgTransport>(swaymsg_path);
+}
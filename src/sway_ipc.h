@@ -0,0 +1,284 @@
+/**
+ * @brief Sway (i3) IPC protocol definitions and message framing.
+ * @file sway_ipc.h
+ *
+ * See `man sway-ipc`. Every message has a 14 byte header consisting of
+ * the magic string `i3-ipc`, payload length and payload type (both
+ * 32-bit integers in native byte order) followed by the payload.
+ */
+#pragma once
+#include "stop_event.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ipc {
+  /// Magic string at the beginning of every message.
+  constexpr std::string_view MAGIC = "i3-ipc";
+  /// Size of the message header in bytes.
+  constexpr size_t HEADER_SIZE = MAGIC.size() + 2 * sizeof(uint32_t);
+  /// Bit set in message type of events.
+  constexpr uint32_t EVENT_BIT = 0x80000000;
+  /// Time a request may take unless set by Transport::SetTimeout().
+  constexpr std::chrono::milliseconds DEFAULT_TIMEOUT{2000};
+
+  /// Message types which can be sent to sway.
+  enum class MsgType : uint32_t {
+    run_command = 0,
+    get_workspaces = 1,
+    subscribe = 2,
+    get_outputs = 3,
+    get_tree = 4,
+    get_marks = 5,
+    get_bar_config = 6,
+    get_version = 7,
+    get_binding_modes = 8,
+    get_config = 9,
+    send_tick = 10,
+    sync = 11,
+    get_binding_state = 12,
+    get_inputs = 100,
+    get_seats = 101,
+  };
+
+  /// Event types sway sends to subscribed clients (with EVENT_BIT set).
+  enum class EventType : uint32_t {
+    workspace = EVENT_BIT | 0,
+    output = EVENT_BIT | 1,
+    mode = EVENT_BIT | 2,
+    window = EVENT_BIT | 3,
+    barconfig_update = EVENT_BIT | 4,
+    binding = EVENT_BIT | 5,
+    shutdown = EVENT_BIT | 6,
+    tick = EVENT_BIT | 7,
+    bar_state_update = EVENT_BIT | 20,
+    input = EVENT_BIT | 21,
+  };
+
+  /// Single decoded message.
+  struct Message {
+    uint32_t type;
+    std::string payload;
+  };
+
+  /// Sway didn't reply before the deadline of the request, which was cancelled.
+  class TimeoutError : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  /// Get message type from its `swaymsg -t` name (e.g. `get_inputs`).
+  std::optional<MsgType> GetMsgType(std::string_view name);
+  /// Get `swaymsg -t` name of the message type.
+  std::string_view GetMsgTypeName(MsgType type);
+
+  /// Encode message into its wire format.
+  std::string encode(uint32_t type, std::string_view payload);
+  inline std::string encode(MsgType type, std::string_view payload) { return encode(uint32_t(type), payload); }
+
+  /**
+   * @brief Decode message header.
+   * @param header Buffer of at least HEADER_SIZE bytes.
+   * @param out_len Payload length.
+   * @param out_type Payload type.
+   * @return FALSE if the magic string doesn't match.
+   */
+  bool decode_header(const char* header, uint32_t& out_len, uint32_t& out_type);
+
+  /**
+   * @brief Write whole message to file descriptor.
+   * @return FALSE on failure.
+   */
+  bool write_message(int fd, uint32_t type, std::string_view payload);
+  /**
+   * @brief Read whole message from file descriptor (blocking).
+   * @return Empty on failure or when the peer closed the connection.
+   */
+  std::optional<Message> read_message(int fd);
+
+  /**
+   * @brief Connection to sway over which requests and events are exchanged.
+   *
+   * Besides blocking Request(), requests can be submitted without waiting
+   * for their replies. Transports able to pipeline (SocketTransport) send
+   * them right away, so that several requests are in flight at once and the
+   * replies are matched to them in order. Others run the submitted requests
+   * one by one once their reply is needed.
+   *
+   * Every request has a deadline (see SetTimeout()). When sway doesn't reply
+   * in time, the request and all requests submitted before its reply came
+   * are cancelled and fail with TimeoutError, so a wedged sway never blocks
+   * the caller indefinitely and late replies are never mistaken for replies
+   * to later requests.
+   */
+  class Transport {
+  public:
+    /// Identifies submitted request. Tickets increase in order of submission.
+    using Ticket = uint64_t;
+
+    virtual ~Transport() = default;
+
+    /**
+     * @brief Send request and wait for its reply.
+     * @return Reply payload (json).
+     * @exception std::runtime_error On failure.
+     * @exception TimeoutError When sway doesn't reply in time.
+     */
+    virtual std::string Request(MsgType type, const std::string& payload) = 0;
+    /**
+     * @brief Send request without waiting for its reply.
+     * @exception std::runtime_error On failure.
+     */
+    virtual Ticket Submit(MsgType type, const std::string& payload);
+    /**
+     * @brief Wait for reply of submitted request.
+     *
+     * Each reply can be taken only once, but in any order.
+     * @exception std::runtime_error On failure or unknown ticket.
+     * @exception TimeoutError When the request was cancelled.
+     */
+    virtual std::string Wait(Ticket ticket);
+    /**
+     * @brief Return TRUE if Wait() would return without blocking.
+     *
+     * Transports which can't pipeline run the queued requests here.
+     */
+    virtual bool Ready(Ticket ticket);
+    /**
+     * @brief Subscribe to events.
+     * @param events Json array of event names (e.g. `["input", "output"]`).
+     * @return FALSE if the transport doesn't support events.
+     */
+    virtual bool Subscribe(const std::string&) { return false; }
+    /**
+     * @brief Wait for the next event.
+     * @param stop_fd Descriptor ending the wait once readable (StopEvent::Fd()).
+     * @return Empty if stopped or interrupted by a signal.
+     */
+    virtual std::optional<Message> NextEvent(int) { return {}; }
+
+    /// Set time after which requests fail with TimeoutError.
+    virtual void SetTimeout(std::chrono::milliseconds timeout) { m_timeout = timeout; }
+    inline std::chrono::milliseconds Timeout() const { return m_timeout; }
+
+  protected:
+    std::chrono::milliseconds m_timeout = DEFAULT_TIMEOUT;
+
+  private:
+    /// Submitted requests not sent yet, the first one has m_queuedFirst ticket.
+    std::deque<std::pair<MsgType, std::string>> m_queued;
+    Ticket m_queuedFirst = 0;
+    std::unordered_map<Ticket, std::string> m_replies;
+    Ticket m_cancelledFirst = 0; ///< Requests cancelled by the last timeout
+    Ticket m_cancelledEnd = 0;   ///< are in [m_cancelledFirst, m_cancelledEnd)
+  };
+
+  /// Transport calling swaymsg executable for every request. Has no events.
+  class SwaymsgTransport : public Transport {
+  public:
+    SwaymsgTransport(const std::string& swaymsg_path) : m_swaymsg(swaymsg_path) {}
+    std::string Request(MsgType type, const std::string& payload) override;
+
+  private:
+    std::string m_swaymsg;
+  };
+
+  /// Transport speaking the sway IPC protocol over unix socket.
+  class SocketTransport : public Transport {
+  public:
+    /**
+     * @param socket_path Path to the sway socket (usually $SWAYSOCK).
+     * @exception std::runtime_error When unable to connect.
+     */
+    SocketTransport(const std::string& socket_path);
+    ~SocketTransport();
+    SocketTransport(const SocketTransport&) = delete;
+    SocketTransport& operator=(const SocketTransport&) = delete;
+
+    std::string Request(MsgType type, const std::string& payload) override;
+    Ticket Submit(MsgType type, const std::string& payload) override;
+    std::string Wait(Ticket ticket) override;
+    bool Ready(Ticket ticket) override;
+    bool Subscribe(const std::string& events) override;
+    std::optional<Message> NextEvent(int stop_fd) override;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+    /// Request without reply.
+    struct InFlight {
+      uint32_t type;
+      Clock::time_point deadline;
+    };
+
+    std::string m_path;
+    int m_fd{-1};      ///< Connection for requests, -1 if reconnecting failed.
+    int m_eventFd{-1}; ///< Connection for subscribed events.
+    Ticket m_submitted = 0; ///< Number of requests sent
+    Ticket m_received = 0;  ///< Number of replies read
+    std::deque<InFlight> m_inFlight; ///< Requests without reply in order
+    std::unordered_map<Ticket, std::string> m_replies; ///< Replies not taken yet
+    std::string m_readBuf; ///< Received data not decoded yet
+    Ticket m_cancelledFirst = 0; ///< Requests cancelled by the last timeout
+    Ticket m_cancelledEnd = 0;   ///< are in [m_cancelledFirst, m_cancelledEnd)
+
+    /// Read replies which already arrived, wait for at least one if `block`.
+    void receive(bool block);
+    /**
+     * @brief Cancel all requests in flight and connect again.
+     *
+     * Sway replies in order, so the late replies would be taken for replies
+     * to the following requests. A new connection drops them.
+     * @exception TimeoutError Always, describing the request of given type.
+     */
+    [[noreturn]] void cancel(uint32_t type);
+  };
+
+  /// Receives events of a transport on a background thread.
+  class EventPump {
+  public:
+    /**
+     * @param transport Transport to read events from. Must outlive the pump.
+     * @param events Json array of event names to subscribe to.
+     * @param on_event Called from the background thread after every event.
+     */
+    EventPump(Transport& transport, const std::string& events, std::function<void()> on_event);
+    ~EventPump();
+    EventPump(const EventPump&) = delete;
+    EventPump& operator=(const EventPump&) = delete;
+
+    /// Return and remove all events received so far.
+    std::vector<Message> Poll();
+    /// FALSE if the transport doesn't support events.
+    inline bool Running() const { return m_thread.joinable(); }
+
+  private:
+    Transport& m_transport;
+    std::function<void()> m_onEvent;
+    StopEvent m_stop;
+    std::mutex m_mutex;
+    std::vector<Message> m_queue;
+    std::thread m_thread;
+
+    void run();
+  };
+
+  /// Open unix socket connection. Returns -1 on failure.
+  int connect_socket(const std::string& path);
+
+  /**
+   * @brief Create transport to the running sway.
+   * @param swaymsg_path swaymsg executable used when the socket is not available.
+   * @param native Use socket from $SWAYSOCK if available.
+   */
+  std::unique_ptr<Transport> connect(const std::string& swaymsg_path, bool native = true);
+}
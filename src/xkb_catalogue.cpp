@@ -0,0 +1,390 @@
+/**
+ * @brief Implementation of xkb::Catalogue
+ * @file xkb_catalogue.cpp
+ */
+#include "xkb_catalogue.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace xkb;
+
+namespace {
+  constexpr std::string_view CACHE_MAGIC = "SWICXKB";
+  constexpr uint8_t CACHE_VERSION = 1;
+
+  inline char lower(char c) { return std::tolower((unsigned char)c); }
+
+  bool istarts_with(std::string_view str, std::string_view prefix) {
+    if (prefix.size() > str.size())
+      return false;
+    for (size_t i = 0; i < prefix.size(); i++)
+      if (lower(str[i]) != lower(prefix[i]))
+        return false;
+    return true;
+  }
+
+  bool icontains(std::string_view str, std::string_view needle) {
+    for (size_t i = 0; i + needle.size() <= str.size(); i++)
+      if (istarts_with(str.substr(i), needle))
+        return true;
+    return false;
+  }
+
+  // Match characters of the needle in order. Returns number of characters
+  // skipped between the matched ones or -1 if there is no match.
+  int fuzzy_gaps(std::string_view str, std::string_view needle) {
+    size_t n = 0;
+    int gaps = 0;
+    bool started = false;
+    for (char c : str) {
+      if (n == needle.size())
+        break;
+      if (lower(c) == lower(needle[n])) {
+        n++;
+        started = true;
+      } else if (started) {
+        gaps++;
+      }
+    }
+    return n == needle.size() ? gaps : -1;
+  }
+
+  // Rank of the entry for the query, higher is better, -1 for no match.
+  int score(std::string_view name, std::string_view desc, std::string_view query) {
+    if (query.empty())
+      return 0;
+    if (name.size() == query.size() && istarts_with(name, query))
+      return 500;
+    if (istarts_with(name, query))
+      return 400;
+    if (istarts_with(desc, query))
+      return 300;
+    if (icontains(name, query) || icontains(desc, query))
+      return 200;
+    int gaps = fuzzy_gaps(desc, query);
+    if (gaps < 0)
+      gaps = fuzzy_gaps(name, query);
+    if (gaps < 0)
+      return -1;
+    return std::max(1, 100 - gaps);
+  }
+
+  // Append XML character data to `out` with entities decoded.
+  void append_text(std::string& out, std::string_view text) {
+    static const std::pair<std::string_view, char> entities[] = {
+      {"&lt;", '<'}, {"&gt;", '>'}, {"&amp;", '&'}, {"&quot;", '"'}, {"&apos;", '\''}};
+    for (size_t i = 0; i < text.size(); i++) {
+      if (text[i] != '&') {
+        out += text[i];
+        continue;
+      }
+      bool decoded = false;
+      for (auto& [entity, c] : entities) {
+        if (text.substr(i, entity.size()) == entity) {
+          out += c;
+          i += entity.size() - 1;
+          decoded = true;
+          break;
+        }
+      }
+      // Numeric references are only expected in the ASCII range.
+      if (!decoded && text.substr(i, 2) == "&#") {
+        size_t end = text.find(';', i);
+        if (end != std::string_view::npos) {
+          bool hex = text[i + 2] == 'x';
+          std::string num(text.substr(i + (hex ? 3 : 2), end - i - (hex ? 3 : 2)));
+          long code = std::strtol(num.c_str(), nullptr, hex ? 16 : 10);
+          if (code > 0 && code < 128) {
+            out += char(code);
+            i = end;
+            decoded = true;
+          }
+        }
+      }
+      if (!decoded)
+        out += '&';
+    }
+  }
+
+  // Identify version of the rules file by its modification time and size.
+  std::optional<uint64_t> file_stamp(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0)
+      return {};
+    uint64_t mtime = uint64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return mtime ^ (uint64_t(st.st_size) << 40);
+  }
+
+  template <typename T> void write_vec(std::ostream& os, const std::vector<T>& vec) {
+    uint32_t size = vec.size();
+    os.write((const char*)&size, sizeof(size));
+    os.write((const char*)vec.data(), sizeof(T) * vec.size());
+  }
+
+  template <typename T> bool read_vec(std::istream& is, std::vector<T>& vec) {
+    uint32_t size;
+    if (!is.read((char*)&size, sizeof(size)))
+      return false;
+    vec.resize(size);
+    return bool(is.read((char*)vec.data(), sizeof(T) * size));
+  }
+}
+
+uint32_t Catalogue::intern(std::string_view str) {
+  uint32_t offset = m_strings.size();
+  m_strings.append(str);
+  m_strings += '\0';
+  return offset;
+}
+
+void Catalogue::index() {
+  m_layoutsByName.resize(m_layouts.size());
+  for (uint32_t i = 0; i < m_layouts.size(); i++)
+    m_layoutsByName[i] = i;
+  std::sort(m_layoutsByName.begin(), m_layoutsByName.end(), [this](uint32_t a, uint32_t b) {
+    return std::strcmp(Name(m_layouts[a]), Name(m_layouts[b])) < 0;
+  });
+}
+
+Catalogue Catalogue::Parse(std::string_view xml) {
+  Catalogue cat;
+  cat.intern(""); // Offset 0 is an empty string for missing fields.
+
+  // Names of the open elements. Only the nesting matters, so the views into
+  // the source are enough and no DOM is built.
+  std::vector<std::string_view> stack;
+  std::string text;
+
+  // Entry owning the config item at the top of the stack.
+  const auto& owner = [&]() -> Item* {
+    if (stack.size() < 3 || stack[stack.size() - 2] != "configItem")
+      return nullptr;
+    std::string_view elem = stack[stack.size() - 3];
+    std::vector<Item>* items = elem == "layout"    ? &cat.m_layouts
+                             : elem == "variant" ? &cat.m_variants
+                             : elem == "group"   ? &cat.m_groups
+                             : elem == "option"  ? &cat.m_options
+                                                 : nullptr;
+    return items && !items->empty() ? &items->back() : nullptr;
+  };
+
+  size_t pos = 0;
+  while (pos < xml.size()) {
+    size_t lt = xml.find('<', pos);
+    if (lt == std::string_view::npos)
+      break;
+    // Character data is only needed for names and descriptions.
+    bool capture = !stack.empty() && (stack.back() == "name" || stack.back() == "description");
+    if (capture)
+      append_text(text, xml.substr(pos, lt - pos));
+
+    if (xml.substr(lt, 4) == "<!--") {
+      pos = xml.find("-->", lt);
+      if (pos == std::string_view::npos)
+        break;
+      pos += 3;
+      continue;
+    }
+    size_t gt = xml.find('>', lt);
+    if (gt == std::string_view::npos)
+      throw std::runtime_error("Unterminated tag in xkb rules");
+    std::string_view tag = xml.substr(lt + 1, gt - lt - 1);
+    pos = gt + 1;
+
+    // Declarations, doctype and processing instructions.
+    if (tag.empty() || tag[0] == '?' || tag[0] == '!')
+      continue;
+
+    if (tag[0] == '/') {
+      if (stack.empty())
+        throw std::runtime_error("Unbalanced tag in xkb rules");
+      if (capture) {
+        if (Item* item = owner())
+          (stack.back() == "name" ? item->name : item->desc) = cat.intern(text);
+        text.clear();
+      }
+      stack.pop_back();
+      continue;
+    }
+    if (tag.back() == '/')
+      continue;
+
+    std::string_view name = tag.substr(0, tag.find_first_of(" \t\r\n"));
+    stack.push_back(name);
+    if (name == "layout") {
+      cat.m_layouts.push_back({0, 0, 0, uint32_t(cat.m_variants.size()), 0});
+    } else if (name == "variant" && !cat.m_layouts.empty()) {
+      cat.m_variants.push_back({0, 0, uint32_t(cat.m_layouts.size() - 1), 0, 0});
+      cat.m_layouts.back().count++;
+    } else if (name == "group") {
+      cat.m_groups.push_back({0, 0, 0, uint32_t(cat.m_options.size()), 0});
+    } else if (name == "option" && !cat.m_groups.empty()) {
+      cat.m_options.push_back({0, 0, uint32_t(cat.m_groups.size() - 1), 0, 0});
+      cat.m_groups.back().count++;
+    }
+  }
+
+  cat.m_strings.shrink_to_fit();
+  cat.index();
+  return cat;
+}
+
+Catalogue Catalogue::Load(const std::string& rules_path, const std::string& cache_path) {
+  auto stamp = file_stamp(rules_path);
+  if (!stamp)
+    throw std::runtime_error("Failed to open xkb rules " + rules_path);
+  if (!cache_path.empty())
+    if (auto cached = LoadCache(cache_path, *stamp))
+      return std::move(*cached);
+
+  int fd = open(rules_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("Failed to open xkb rules " + rules_path);
+  struct stat st;
+  fstat(fd, &st);
+  void* data = st.st_size > 0 ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("Failed to read xkb rules " + rules_path);
+
+  Catalogue cat;
+  try {
+    cat = Parse(std::string_view((const char*)data, st.st_size));
+  } catch (...) {
+    munmap(data, st.st_size);
+    throw;
+  }
+  munmap(data, st.st_size);
+
+  if (!cache_path.empty())
+    cat.Save(cache_path, *stamp);
+  return cat;
+}
+
+std::string Catalogue::DefaultCachePath() {
+  std::filesystem::path dir;
+  if (const char* cache = std::getenv("XDG_CACHE_HOME"))
+    dir = cache;
+  else if (const char* home = std::getenv("HOME"))
+    dir = std::filesystem::path(home) / ".cache";
+  else
+    return "";
+  return (dir / "swic" / "xkb.cache").string();
+}
+
+bool Catalogue::Save(const std::string& path, uint64_t stamp) const {
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+  // Write to temporary file first, so that readers never see partial cache.
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+      return false;
+    file.write(CACHE_MAGIC.data(), CACHE_MAGIC.size());
+    file.put(CACHE_VERSION);
+    file.write((const char*)&stamp, sizeof(stamp));
+    uint32_t size = m_strings.size();
+    file.write((const char*)&size, sizeof(size));
+    file.write(m_strings.data(), m_strings.size());
+    write_vec(file, m_layouts);
+    write_vec(file, m_variants);
+    write_vec(file, m_groups);
+    write_vec(file, m_options);
+    if (!file)
+      return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+std::optional<Catalogue> Catalogue::LoadCache(const std::string& path, uint64_t stamp) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return {};
+
+  std::string magic(CACHE_MAGIC.size(), '\0');
+  file.read(magic.data(), magic.size());
+  uint64_t file_stamp;
+  if (magic != CACHE_MAGIC || file.get() != CACHE_VERSION ||
+      !file.read((char*)&file_stamp, sizeof(file_stamp)) || file_stamp != stamp)
+    return {};
+
+  Catalogue cat;
+  uint32_t size;
+  if (!file.read((char*)&size, sizeof(size)))
+    return {};
+  cat.m_strings.resize(size);
+  if (!file.read(cat.m_strings.data(), size) || !read_vec(file, cat.m_layouts) ||
+      !read_vec(file, cat.m_variants) || !read_vec(file, cat.m_groups) ||
+      !read_vec(file, cat.m_options))
+    return {};
+
+  // Reject corrupted cache rather than reading out of bounds later.
+  for (auto* items : {&cat.m_layouts, &cat.m_variants, &cat.m_groups, &cat.m_options})
+    for (auto& item : *items)
+      if (item.name >= size || item.desc >= size)
+        return {};
+  if (size == 0 || cat.m_strings.back() != '\0')
+    return {};
+
+  cat.index();
+  return cat;
+}
+
+const std::vector<Item>& Catalogue::Items(Kind kind) const {
+  switch (kind) {
+  case Kind::layout:
+    return m_layouts;
+  case Kind::variant:
+    return m_variants;
+  case Kind::group:
+    return m_groups;
+  default:
+    return m_options;
+  }
+}
+
+const Item* Catalogue::FindLayout(std::string_view name) const {
+  auto it = std::lower_bound(m_layoutsByName.begin(), m_layoutsByName.end(), name,
+                             [this](uint32_t i, std::string_view n) { return Name(m_layouts[i]) < n; });
+  if (it == m_layoutsByName.end() || Name(m_layouts[*it]) != name)
+    return nullptr;
+  return &m_layouts[*it];
+}
+
+std::vector<uint32_t> Catalogue::Search(Kind kind, std::string_view query,
+                                        std::optional<uint32_t> parent) const {
+  const auto& items = Items(kind);
+  std::vector<std::pair<int, uint32_t>> matches;
+  for (uint32_t i = 0; i < items.size(); i++) {
+    if (parent && items[i].parent != *parent)
+      continue;
+    int rank = score(Name(items[i]), Description(items[i]), query);
+    if (rank >= 0)
+      matches.emplace_back(rank, i);
+  }
+  // Equally ranked entries with shorter description are closer matches
+  // ("German" before "German (Austria)").
+  std::stable_sort(matches.begin(), matches.end(), [&](const auto& a, const auto& b) {
+    if (a.first != b.first)
+      return a.first > b.first;
+    return !query.empty() && std::strlen(Description(items[a.second])) <
+                             std::strlen(Description(items[b.second]));
+  });
+
+  std::vector<uint32_t> out;
+  out.reserve(matches.size());
+  for (auto& [rank, i] : matches)
+    out.push_back(i);
+  return out;
+}
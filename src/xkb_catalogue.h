@@ -0,0 +1,88 @@
+/**
+ * @brief Searchable catalogue of xkb layouts, variants and options.
+ * @file xkb_catalogue.h
+ *
+ * The catalogue is built from the xkb rules registry (evdev.xml) by a
+ * streaming parser and stored in a compact form: all names and descriptions
+ * are kept in a single string pool and entries only hold offsets into it.
+ * The built index is cached in `$XDG_CACHE_HOME/swic`, so the XML is only
+ * parsed again when it changes.
+ */
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace xkb {
+  /// Default location of the rules registry.
+  constexpr const char* DEFAULT_RULES = "/usr/share/X11/xkb/rules/evdev.xml";
+
+  /// Kinds of entries in the catalogue.
+  enum class Kind { layout, variant, group, option };
+
+  /// Entry of the catalogue.
+  struct Item {
+    uint32_t name;   ///< Offset of the name in the string pool
+    uint32_t desc;   ///< Offset of the description in the string pool
+    uint32_t parent; ///< Layout of variant or group of option
+    uint32_t first;  ///< First variant of layout or option of group
+    uint32_t count;  ///< Number of variants or options
+  };
+
+  class Catalogue {
+  public:
+    /// Parse rules registry XML.
+    static Catalogue Parse(std::string_view xml);
+    /**
+     * @brief Load catalogue from the cache or parse the rules registry.
+     * @param rules_path Path of the rules registry (evdev.xml).
+     * @param cache_path Where the parsed catalogue is cached. Disabled if empty.
+     * @exception std::runtime_error When the rules registry can't be read.
+     */
+    static Catalogue Load(const std::string& rules_path,
+                          const std::string& cache_path = DefaultCachePath());
+    /// `$XDG_CACHE_HOME/swic/xkb.cache` or empty if there is no cache directory.
+    static std::string DefaultCachePath();
+
+    /// Write catalogue to cache tagged with `stamp` of the source.
+    bool Save(const std::string& path, uint64_t stamp) const;
+    /// Read catalogue from cache if it was created from source with `stamp`.
+    static std::optional<Catalogue> LoadCache(const std::string& path, uint64_t stamp);
+
+    inline const char* Name(const Item& item) const { return m_strings.data() + item.name; }
+    inline const char* Description(const Item& item) const { return m_strings.data() + item.desc; }
+
+    /// Entries of given kind. Variants and options are grouped by parent.
+    const std::vector<Item>& Items(Kind kind) const;
+    /// Find layout by exact name.
+    const Item* FindLayout(std::string_view name) const;
+
+    /**
+     * @brief Find entries matching the query.
+     *
+     * Entries are ranked by exact name match, name prefix, description
+     * prefix, substring and finally fuzzy (subsequence) match. Matching is
+     * case insensitive. Empty query matches all entries in original order.
+     * @param parent Only entries with this parent (variants, options).
+     * @return Indices into Items(kind).
+     */
+    std::vector<uint32_t> Search(Kind kind, std::string_view query,
+                                 std::optional<uint32_t> parent = {}) const;
+
+    inline bool Empty() const { return m_layouts.empty(); }
+
+  private:
+    std::string m_strings;
+    std::vector<Item> m_layouts;
+    std::vector<Item> m_variants;
+    std::vector<Item> m_groups;
+    std::vector<Item> m_options;
+    /// Layout indices sorted by name for binary search in FindLayout().
+    std::vector<uint32_t> m_layoutsByName;
+
+    uint32_t intern(std::string_view str);
+    void index();
+  };
+}